@@ -0,0 +1,532 @@
+/*
+ * binarymap.cpp
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "binarymap.h"
+
+#include "gidmapper.h"
+#include "map.h"
+#include "mapobject.h"
+#include "mapreader.h"
+#include "objectgroup.h"
+#include "tile.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QBuffer>
+#include <QColor>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPolygonF>
+#include <QtEndian>
+
+#include <cstring>
+
+using namespace Tiled;
+
+static const char binaryMapMagic[4] = { 'T', 'M', 'B', '\0' };
+static const quint32 binaryMapVersion = 1;
+static const int headerSize = 24;
+static const int directoryEntrySize = 12;
+static const int tileDataAlignment = 16;
+
+enum LayerType {
+    TileLayerType = 0,
+    ObjectGroupType = 1
+};
+
+static void setupStream(QDataStream &stream)
+{
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setVersion(QDataStream::Qt_4_6);
+}
+
+static quint32 readUInt32(const uchar *data)
+{
+    return qFromLittleEndian<quint32>(data);
+}
+
+static QDataStream &operator>>(QDataStream &stream, Properties &properties)
+{
+    return stream >> static_cast<QMap<QString, QString>&>(properties);
+}
+
+static QDataStream &operator<<(QDataStream &stream,
+                               const Properties &properties)
+{
+    return stream << static_cast<const QMap<QString, QString>&>(properties);
+}
+
+
+bool BinaryMapReader::isBinaryMap(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    return file.read(sizeof(binaryMapMagic)) ==
+            QByteArray::fromRawData(binaryMapMagic, sizeof(binaryMapMagic));
+}
+
+Map *BinaryMapReader::readMap(const QString &fileName)
+{
+    mError.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        mError = tr("Unable to read file: %1").arg(fileName);
+        return 0;
+    }
+
+    const qint64 fileSize = file.size();
+    if (fileSize < headerSize) {
+        mError = tr("Not a binary map file.");
+        return 0;
+    }
+
+    // Prefer a memory mapping, so that only the used pages are read
+    QByteArray contents;
+    const uchar *data = file.map(0, fileSize);
+    if (!data) {
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>(contents.constData());
+    }
+
+    if (memcmp(data, binaryMapMagic, sizeof(binaryMapMagic)) != 0) {
+        mError = tr("Not a binary map file.");
+        return 0;
+    }
+
+    const quint32 version = readUInt32(data + 4);
+    const quint32 metadataOffset = readUInt32(data + 8);
+    const quint32 metadataSize = readUInt32(data + 12);
+    const quint32 layerCount = readUInt32(data + 16);
+    const quint32 directoryOffset = readUInt32(data + 20);
+
+    if (version != binaryMapVersion) {
+        mError = tr("Unsupported binary map version: %1").arg(version);
+        return 0;
+    }
+
+    if (quint64(metadataOffset) + metadataSize > quint64(fileSize)
+            || quint64(directoryOffset) + quint64(layerCount) *
+               directoryEntrySize > quint64(fileSize)) {
+        mError = tr("Corrupt binary map file.");
+        return 0;
+    }
+
+    const QByteArray metadata =
+            QByteArray::fromRawData(reinterpret_cast<const char*>(data) +
+                                    metadataOffset, metadataSize);
+    QDataStream stream(metadata);
+    setupStream(stream);
+
+    qint32 orientation, width, height, tileWidth, tileHeight;
+    stream >> orientation >> width >> height >> tileWidth >> tileHeight;
+
+    Map *map = new Map(static_cast<Map::Orientation>(orientation),
+                       width, height, tileWidth, tileHeight);
+
+    Properties mapProperties;
+    stream >> mapProperties;
+    map->setProperties(mapProperties);
+
+    const QDir mapDir = QFileInfo(fileName).dir();
+    GidMapper gidMapper;
+
+    qint32 tilesetCount;
+    stream >> tilesetCount;
+
+    for (int i = 0; i < tilesetCount && mError.isEmpty(); ++i) {
+        quint32 firstGid;
+        QString tilesetFileName;
+        stream >> firstGid >> tilesetFileName;
+
+        Tileset *tileset = 0;
+
+        if (!tilesetFileName.isEmpty()) {
+            const QString source = mapDir.filePath(tilesetFileName);
+            MapReader reader;
+            tileset = reader.readTileset(source);
+            if (!tileset) {
+                mError = tr("Error while loading tileset '%1': %2")
+                        .arg(source, reader.errorString());
+                break;
+            }
+        } else {
+            QString name, imageSource;
+            qint32 tilesetTileWidth, tilesetTileHeight, spacing, margin;
+            qint32 imageWidth;
+            QColor transparentColor;
+            Properties tilesetProperties;
+
+            stream >> name >> tilesetTileWidth >> tilesetTileHeight
+                   >> spacing >> margin >> imageSource >> transparentColor
+                   >> imageWidth >> tilesetProperties;
+
+            if (stream.status() != QDataStream::Ok
+                    || tilesetTileWidth <= 0 || tilesetTileHeight <= 0
+                    || spacing < 0 || margin < 0) {
+                mError = tr("Invalid tileset parameters for tileset '%1'")
+                        .arg(name);
+                break;
+            }
+
+            tileset = new Tileset(name, tilesetTileWidth, tilesetTileHeight,
+                                  spacing, margin);
+            tileset->setTransparentColor(transparentColor);
+            tileset->setProperties(tilesetProperties);
+
+            if (!imageSource.isEmpty()) {
+                const QString source = mapDir.filePath(imageSource);
+                if (!tileset->loadFromImage(QImage(source), source)) {
+                    mError = tr("Error loading tileset image:\n'%1'")
+                            .arg(source);
+                }
+            }
+
+            qint32 tilePropertiesCount;
+            stream >> tilePropertiesCount;
+            for (int j = 0; j < tilePropertiesCount; ++j) {
+                qint32 id;
+                Properties tileProperties;
+                stream >> id >> tileProperties;
+                if (id < 0 || id >= tileset->tileCount()) {
+                    mError = tr("Corrupt binary map file.");
+                    break;
+                }
+                tileset->tileAt(id)->setProperties(tileProperties);
+            }
+
+            gidMapper.setTilesetWidth(tileset, imageWidth);
+        }
+
+        map->addTileset(tileset);
+        gidMapper.insert(firstGid, tileset);
+    }
+
+    const uchar *directory = data + directoryOffset;
+
+    for (quint32 i = 0; i < layerCount && mError.isEmpty(); ++i) {
+        const uchar *entry = directory + i * directoryEntrySize;
+        const quint32 type = readUInt32(entry);
+        const quint32 dataOffset = readUInt32(entry + 4);
+        const quint32 dataSize = readUInt32(entry + 8);
+
+        QString name;
+        qint32 x, y, layerWidth, layerHeight;
+        float opacity;
+        bool visible;
+        Properties layerProperties;
+
+        stream >> name >> x >> y >> layerWidth >> layerHeight
+               >> opacity >> visible >> layerProperties;
+
+        if (stream.status() != QDataStream::Ok
+                || layerWidth < 0 || layerHeight < 0) {
+            mError = tr("Corrupt binary map file.");
+            break;
+        }
+
+        Layer *layer = 0;
+
+        if (type == TileLayerType) {
+            const quint64 expectedSize = quint64(layerWidth) * layerHeight * 4;
+            if (dataSize != expectedSize
+                    || quint64(dataOffset) + dataSize > quint64(fileSize)) {
+                mError = tr("Corrupt layer data for layer '%1'").arg(name);
+                break;
+            }
+
+            TileLayer *tileLayer = new TileLayer(name, x, y,
+                                                 layerWidth, layerHeight);
+            const uchar *gids = data + dataOffset;
+
+            for (int ty = 0; ty < layerHeight && mError.isEmpty(); ++ty) {
+                for (int tx = 0; tx < layerWidth; ++tx) {
+                    const quint32 gid = readUInt32(gids);
+                    gids += 4;
+
+                    bool ok;
+                    const Cell cell = gidMapper.gidToCell(gid, ok);
+                    if (!ok) {
+                        mError = tr("Invalid tile: %1").arg(gid);
+                        break;
+                    }
+                    if (!cell.isEmpty())
+                        tileLayer->setCell(tx, ty, cell);
+                }
+            }
+
+            layer = tileLayer;
+        } else if (type == ObjectGroupType) {
+            ObjectGroup *objectGroup = new ObjectGroup(name, x, y,
+                                                       layerWidth,
+                                                       layerHeight);
+            QColor color;
+            qint32 objectCount;
+            stream >> color >> objectCount;
+            objectGroup->setColor(color);
+
+            for (int j = 0; j < objectCount; ++j) {
+                QString objectName, objectType;
+                quint32 gid;
+                QPointF pos;
+                QSizeF size;
+                qint32 shape;
+                QPolygonF polygon;
+                Properties objectProperties;
+
+                stream >> objectName >> objectType >> gid >> pos >> size
+                       >> shape >> polygon >> objectProperties;
+
+                Cell cell;
+                if (gid) {
+                    bool ok;
+                    cell = gidMapper.gidToCell(gid, ok);
+                    if (!ok) {
+                        mError = tr("Invalid tile: %1").arg(gid);
+                        break;
+                    }
+                }
+
+                MapObject *object = new MapObject(objectName, objectType,
+                                                  pos, size);
+                object->setShape(static_cast<MapObject::Shape>(shape));
+                object->setPolygon(polygon);
+                object->setProperties(objectProperties);
+
+                if (gid) {
+                    object->setTile(cell.tile);
+                    object->setFlipHorizontally(cell.flippedHorizontally);
+                    object->setFlipVertically(cell.flippedVertically);
+                    object->setRotation(cell.ang);
+                }
+
+                objectGroup->addObject(object);
+            }
+
+            layer = objectGroup;
+        } else {
+            mError = tr("Corrupt binary map file.");
+            break;
+        }
+
+        layer->setOpacity(opacity);
+        layer->setVisible(visible);
+        layer->setProperties(layerProperties);
+        map->addLayer(layer);
+    }
+
+    if (mError.isEmpty() && stream.status() != QDataStream::Ok)
+        mError = tr("Corrupt binary map file.");
+
+    if (!mError.isEmpty()) {
+        // The tilesets are not owned by the map
+        qDeleteAll(map->tilesets());
+        delete map;
+        return 0;
+    }
+
+    return map;
+}
+
+
+bool BinaryMapWriter::writeMap(const Map *map, const QString &fileName)
+{
+    mError.clear();
+
+    // A layer that failed to decode would be written with its cells missing,
+    // overwriting the original data
+    foreach (Layer *layer, map->layers()) {
+        const TileLayer *tileLayer = layer->asTileLayer();
+        if (tileLayer && !tileLayer->decodingError().isEmpty()) {
+            mError = tr("Layer '%1' could not be loaded: %2")
+                    .arg(tileLayer->name(), tileLayer->decodingError());
+            return false;
+        }
+    }
+
+    const QDir mapDir = QFileInfo(fileName).absoluteDir();
+    const GidMapper gidMapper(map->tilesets());
+
+    // Write the metadata first, since it determines where the tile data
+    // goes
+    QByteArray metadata;
+    QBuffer metadataBuffer(&metadata);
+    metadataBuffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&metadataBuffer);
+    setupStream(stream);
+
+    stream << qint32(map->orientation())
+           << qint32(map->width()) << qint32(map->height())
+           << qint32(map->tileWidth()) << qint32(map->tileHeight())
+           << map->properties();
+
+    stream << qint32(map->tilesets().size());
+
+    uint firstGid = 1;
+    foreach (const Tileset *tileset, map->tilesets()) {
+        if (tileset->isExternal()) {
+            stream << quint32(firstGid)
+                   << mapDir.relativeFilePath(tileset->fileName());
+        } else {
+            QString imageSource = tileset->imageSource();
+            if (!imageSource.isEmpty())
+                imageSource = mapDir.relativeFilePath(imageSource);
+
+            stream << quint32(firstGid) << QString()
+                   << tileset->name()
+                   << qint32(tileset->tileWidth())
+                   << qint32(tileset->tileHeight())
+                   << qint32(tileset->tileSpacing())
+                   << qint32(tileset->margin())
+                   << imageSource
+                   << tileset->transparentColor()
+                   << qint32(tileset->imageWidth())
+                   << tileset->properties();
+
+            QList<int> tilesWithProperties;
+            for (int i = 0; i < tileset->tileCount(); ++i)
+                if (!tileset->tileAt(i)->properties().isEmpty())
+                    tilesWithProperties.append(i);
+
+            stream << qint32(tilesWithProperties.size());
+            foreach (int id, tilesWithProperties)
+                stream << qint32(id) << tileset->tileAt(id)->properties();
+        }
+
+        firstGid += tileset->tileCount();
+    }
+
+    const int layerCount = map->layerCount();
+    QList<quint32> layerTypes;
+    QList<quint32> tileDataSizes;
+
+    foreach (Layer *layer, map->layers()) {
+        stream << layer->name()
+               << qint32(layer->x()) << qint32(layer->y())
+               << qint32(layer->width()) << qint32(layer->height())
+               << layer->opacity() << layer->isVisible()
+               << layer->properties();
+
+        if (layer->asTileLayer()) {
+            layerTypes.append(TileLayerType);
+            tileDataSizes.append(layer->width() * layer->height() * 4);
+        } else if (ObjectGroup *objectGroup = layer->asObjectGroup()) {
+            layerTypes.append(ObjectGroupType);
+            tileDataSizes.append(0);
+
+            stream << objectGroup->color()
+                   << qint32(objectGroup->objectCount());
+
+            foreach (const MapObject *object, objectGroup->objects()) {
+                const uint gid = object->tile()
+                        ? gidMapper.cellToGid(object->getCell()) : 0;
+
+                stream << object->name() << object->type() << quint32(gid)
+                       << object->position() << object->size()
+                       << qint32(object->shape()) << object->polygon()
+                       << object->properties();
+            }
+        }
+    }
+
+    metadataBuffer.close();
+
+    // Determine the layout of the file
+    const quint32 directoryOffset = headerSize;
+    const quint32 metadataOffset = directoryOffset +
+            layerCount * directoryEntrySize;
+    quint32 offset = metadataOffset + metadata.size();
+
+    QList<quint32> tileDataOffsets;
+    foreach (quint32 size, tileDataSizes) {
+        if (size > 0) {
+            offset = (offset + tileDataAlignment - 1) &
+                    ~quint32(tileDataAlignment - 1);
+            tileDataOffsets.append(offset);
+            offset += size;
+        } else {
+            tileDataOffsets.append(0);
+        }
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        mError = tr("Could not open file for writing.");
+        return false;
+    }
+
+    QDataStream out(&file);
+    setupStream(out);
+
+    out.writeRawData(binaryMapMagic, sizeof(binaryMapMagic));
+    out << binaryMapVersion
+        << metadataOffset << quint32(metadata.size())
+        << quint32(layerCount) << directoryOffset;
+
+    for (int i = 0; i < layerCount; ++i)
+        out << layerTypes.at(i) << tileDataOffsets.at(i)
+            << tileDataSizes.at(i);
+
+    out.writeRawData(metadata.constData(), metadata.size());
+
+    for (int i = 0; i < layerCount; ++i) {
+        const TileLayer *tileLayer = map->layerAt(i)->asTileLayer();
+        if (!tileLayer)
+            continue;
+
+        // Pad up to the aligned offset of the tile data
+        const qint64 padding = tileDataOffsets.at(i) - file.pos();
+        out.writeRawData(QByteArray(int(padding), '\0').constData(),
+                         int(padding));
+
+        QByteArray tileData;
+        tileData.resize(tileDataSizes.at(i));
+        uchar *gids = reinterpret_cast<uchar*>(tileData.data());
+
+        for (int y = 0; y < tileLayer->height(); ++y) {
+            for (int x = 0; x < tileLayer->width(); ++x) {
+                const uint gid = gidMapper.cellToGid(tileLayer->cellAt(x, y));
+                qToLittleEndian<quint32>(gid, gids);
+                gids += 4;
+            }
+        }
+
+        out.writeRawData(tileData.constData(), tileData.size());
+    }
+
+    if (file.error() != QFile::NoError) {
+        mError = file.errorString();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * binarymap.h
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BINARYMAP_H
+#define BINARYMAP_H
+
+#include "tiled_global.h"
+
+#include <QCoreApplication>
+#include <QString>
+
+namespace Tiled {
+
+class Map;
+
+/*
+ * The binary map format stores a map in a way that allows it to be loaded
+ * without any parsing of the tile layer data. All numbers are little-endian.
+ *
+ * Header (24 bytes):
+ *   char[4]  magic "TMB\0"
+ *   quint32  format version (currently 1)
+ *   quint32  offset of the metadata
+ *   quint32  size of the metadata
+ *   quint32  number of layers
+ *   quint32  offset of the layer directory
+ *
+ * Layer directory, one entry of 12 bytes for each layer:
+ *   quint32  layer type (0 for tile layers, 1 for object groups)
+ *   quint32  offset of the tile data (tile layers only)
+ *   quint32  size of the tile data (tile layers only)
+ *
+ * Metadata, written with QDataStream (Qt 4.6 format): the map attributes and
+ * properties, the tilesets, and for each layer its attributes, properties
+ * and (for object groups) objects. Object positions are stored in tiles.
+ *
+ * Tile data: for each tile layer, width * height quint32 global tile IDs in
+ * row-major order, at an offset aligned to 16 bytes.
+ */
+
+/**
+ * Reads maps in the binary map format. The file is memory-mapped and the
+ * tile data is read straight from the mapping.
+ */
+class TILEDSHARED_EXPORT BinaryMapReader
+{
+    Q_DECLARE_TR_FUNCTIONS(BinaryMapReader)
+
+public:
+    /**
+     * Reads the map stored in the given \a fileName.
+     *
+     * Returns 0 and sets errorString() when reading failed. The caller
+     * takes ownership over the newly created map and its tilesets.
+     */
+    Map *readMap(const QString &fileName);
+
+    /**
+     * Returns whether the given file starts with the binary map magic.
+     */
+    static bool isBinaryMap(const QString &fileName);
+
+    /**
+     * Returns the error message for the last occurred error.
+     */
+    QString errorString() const { return mError; }
+
+private:
+    QString mError;
+};
+
+/**
+ * Writes maps in the binary map format.
+ */
+class TILEDSHARED_EXPORT BinaryMapWriter
+{
+    Q_DECLARE_TR_FUNCTIONS(BinaryMapWriter)
+
+public:
+    /**
+     * Writes the given \a map to the given \a fileName. References to
+     * external tilesets and images are stored relative to the map.
+     *
+     * Returns false and sets errorString() when writing failed.
+     */
+    bool writeMap(const Map *map, const QString &fileName);
+
+    /**
+     * Returns the error message for the last occurred error.
+     */
+    QString errorString() const { return mError; }
+
+private:
+    QString mError;
+};
+
+} // namespace Tiled
+
+#endif // BINARYMAP_H
@@ -31,6 +31,16 @@
 #include <zlib.h>
 #include <QByteArray>
 #include <QDebug>
+#include <QtEndian>
+
+#ifdef TILED_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+#include <lz4frame.h>
+#include <cstring>
+#endif
 
 using namespace Tiled;
 
@@ -54,8 +64,205 @@ static void logZlibError(int error)
     }
 }
 
-QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
+#ifdef TILED_ZSTD_SUPPORT
+static QByteArray decompressZstd(const QByteArray &data, int expectedSize)
 {
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    if (!stream) {
+        qDebug() << "Out of memory while decompressing data!";
+        return QByteArray();
+    }
+
+    ZSTD_initDStream(stream);
+
+    QByteArray out;
+    out.resize(qMax(expectedSize, 1));
+
+    ZSTD_inBuffer input = { data.constData(), size_t(data.size()), 0 };
+    ZSTD_outBuffer output = { out.data(), size_t(out.size()), 0 };
+
+    size_t ret;
+    do {
+        ret = ZSTD_decompressStream(stream, &output, &input);
+        if (ZSTD_isError(ret)) {
+            qDebug() << "Incorrect zstd compressed data:"
+                     << ZSTD_getErrorName(ret);
+            ZSTD_freeDStream(stream);
+            return QByteArray();
+        }
+
+        if (ret != 0 && output.pos == output.size) {
+            // More output space needed
+            out.resize(out.size() * 2);
+            output.dst = out.data();
+            output.size = out.size();
+        } else if (ret != 0 && input.pos == input.size) {
+            // The frame is incomplete
+            qDebug() << "Incorrect zstd compressed data!";
+            ZSTD_freeDStream(stream);
+            return QByteArray();
+        }
+    } while (ret != 0);
+
+    ZSTD_freeDStream(stream);
+
+    if (input.pos != input.size) {
+        qDebug() << "Incorrect zstd compressed data!";
+        return QByteArray();
+    }
+
+    out.resize(int(output.pos));
+    return out;
+}
+
+static QByteArray compressZstd(const QByteArray &data, int level)
+{
+    if (level < 0)
+        level = ZSTD_CLEVEL_DEFAULT;
+
+    QByteArray out;
+    out.resize(int(ZSTD_compressBound(data.size())));
+
+    const size_t size = ZSTD_compress(out.data(), out.size(),
+                                      data.constData(), data.size(),
+                                      level);
+    if (ZSTD_isError(size)) {
+        qDebug() << "Error while compressing data:"
+                 << ZSTD_getErrorName(size);
+        return QByteArray();
+    }
+
+    out.resize(int(size));
+    return out;
+}
+#endif // TILED_ZSTD_SUPPORT
+
+#ifdef TILED_LZ4_SUPPORT
+static QByteArray decompressLZ4(const QByteArray &data, int expectedSize)
+{
+    LZ4F_dctx *context;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&context,
+                                                     LZ4F_VERSION))) {
+        qDebug() << "Out of memory while decompressing data!";
+        return QByteArray();
+    }
+
+    QByteArray out;
+    out.resize(qMax(expectedSize, 1));
+
+    const char *in = data.constData();
+    const char *inEnd = in + data.size();
+    int outLength = 0;
+    size_t ret;
+
+    do {
+        size_t inSize = inEnd - in;
+        size_t outSize = out.size() - outLength;
+
+        ret = LZ4F_decompress(context, out.data() + outLength, &outSize,
+                              in, &inSize, 0);
+        if (LZ4F_isError(ret)) {
+            qDebug() << "Incorrect LZ4 compressed data:"
+                     << LZ4F_getErrorName(ret);
+            LZ4F_freeDecompressionContext(context);
+            return QByteArray();
+        }
+
+        in += inSize;
+        outLength += int(outSize);
+
+        if (ret != 0 && outLength == out.size()) {
+            // More output space needed
+            out.resize(out.size() * 2);
+        } else if (ret != 0 && in == inEnd) {
+            // The frame is incomplete
+            qDebug() << "Incorrect LZ4 compressed data!";
+            LZ4F_freeDecompressionContext(context);
+            return QByteArray();
+        }
+    } while (ret != 0);
+
+    LZ4F_freeDecompressionContext(context);
+
+    if (in != inEnd) {
+        qDebug() << "Incorrect LZ4 compressed data!";
+        return QByteArray();
+    }
+
+    out.resize(outLength);
+    return out;
+}
+
+static QByteArray compressLZ4(const QByteArray &data, int level)
+{
+    LZ4F_preferences_t preferences;
+    memset(&preferences, 0, sizeof(preferences));
+    preferences.frameInfo.contentSize = data.size();
+    preferences.compressionLevel = qMax(level, 0);
+
+    QByteArray out;
+    out.resize(int(LZ4F_compressFrameBound(data.size(), &preferences)));
+
+    const size_t size = LZ4F_compressFrame(out.data(), out.size(),
+                                           data.constData(), data.size(),
+                                           &preferences);
+    if (LZ4F_isError(size)) {
+        qDebug() << "Error while compressing data:"
+                 << LZ4F_getErrorName(size);
+        return QByteArray();
+    }
+
+    out.resize(int(size));
+    return out;
+}
+#endif // TILED_LZ4_SUPPORT
+
+bool Tiled::isCompressionMethodSupported(CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return true;
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return true;
+#else
+        return false;
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+QByteArray Tiled::decompress(const QByteArray &data, int expectedSize,
+                             CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        break;
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return decompressZstd(data, expectedSize);
+#else
+        qDebug() << "Zstandard compression is not supported!";
+        return QByteArray();
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return decompressLZ4(data, expectedSize);
+#else
+        qDebug() << "LZ4 compression is not supported!";
+        return QByteArray();
+#endif
+    }
+
     QByteArray out;
     out.resize(expectedSize);
     z_stream strm;
@@ -111,10 +318,43 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
     return out;
 }
 
-QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
+static int zlibStrategy(CompressionStrategy strategy)
+{
+    switch (strategy) {
+    case DefaultStrategy:       return Z_DEFAULT_STRATEGY;
+    case FilteredStrategy:      return Z_FILTERED;
+    case HuffmanOnlyStrategy:   return Z_HUFFMAN_ONLY;
+    case RunLengthStrategy:     return Z_RLE;
+    case FixedStrategy:         return Z_FIXED;
+    }
+
+    return Z_DEFAULT_STRATEGY;
+}
+
+QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method,
+                           int level, CompressionStrategy strategy)
 {
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        break;
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return compressZstd(data, level);
+#else
+        qDebug() << "Zstandard compression is not supported!";
+        return QByteArray();
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return compressLZ4(data, level);
+#else
+        qDebug() << "LZ4 compression is not supported!";
+        return QByteArray();
+#endif
+    }
+
     QByteArray out;
-    out.resize(1024);
     int err;
     z_stream strm;
     strm.zalloc = Z_NULL;
@@ -122,18 +362,24 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     strm.opaque = Z_NULL;
     strm.next_in = (Bytef *) data.data();
     strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
 
     const int windowBits = (method == Gzip) ? 15 + 16 : 15;
 
-    err = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits,
-                       8, Z_DEFAULT_STRATEGY);
+    if (level < 0 || level > 9)
+        level = Z_DEFAULT_COMPRESSION;
+
+    err = deflateInit2(&strm, level, Z_DEFLATED, windowBits,
+                       8, zlibStrategy(strategy));
     if (err != Z_OK) {
         logZlibError(err);
         return QByteArray();
     }
 
+    // Usually the bound is enough to compress the data in a single step
+    out.resize(deflateBound(&strm, data.length()));
+    strm.next_out = (Bytef *) out.data();
+    strm.avail_out = out.size();
+
     do {
         err = deflate(&strm, Z_FINISH);
         Q_ASSERT(err != Z_STREAM_ERROR);
@@ -160,3 +406,121 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     out.resize(outLength);
     return out;
 }
+
+static inline quint32 valueAt(const uchar *data, int index)
+{
+    return qFromLittleEndian<quint32>(data + index * 4);
+}
+
+static inline void setValueAt(uchar *data, int index, quint32 value)
+{
+    qToLittleEndian<quint32>(value, data + index * 4);
+}
+
+QByteArray Tiled::filter(const QByteArray &data, FilterMethod method,
+                         int rowLength)
+{
+    if (data.size() % 4 != 0)
+        return QByteArray();
+
+    const int count = data.size() / 4;
+    const uchar *in = reinterpret_cast<const uchar*>(data.constData());
+
+    // Not null, also when there is no data
+    QByteArray out(0, '\0');
+
+    switch (method) {
+    case RowDelta:
+        out.resize(data.size());
+        for (int i = 0; i < count; ++i) {
+            quint32 value = valueAt(in, i);
+            if (i >= rowLength && rowLength > 0)
+                value -= valueAt(in, i - rowLength);
+            setValueAt(reinterpret_cast<uchar*>(out.data()), i, value);
+        }
+        break;
+    case RunLength:
+        for (int i = 0; i < count;) {
+            const quint32 value = valueAt(in, i);
+            quint32 runLength = 1;
+            while (i + int(runLength) < count
+                   && valueAt(in, i + runLength) == value)
+                ++runLength;
+
+            uchar pair[8];
+            qToLittleEndian<quint32>(runLength, pair);
+            qToLittleEndian<quint32>(value, pair + 4);
+            out.append(reinterpret_cast<const char*>(pair), 8);
+
+            i += runLength;
+        }
+        break;
+    case ByteShuffle: {
+        out.resize(data.size());
+        uchar *planes = reinterpret_cast<uchar*>(out.data());
+        for (int i = 0; i < count; ++i)
+            for (int byte = 0; byte < 4; ++byte)
+                planes[byte * count + i] = in[i * 4 + byte];
+        break;
+    }
+    }
+
+    return out;
+}
+
+QByteArray Tiled::unfilter(const QByteArray &data, FilterMethod method,
+                           int rowLength, int maximumSize)
+{
+    if (data.size() % 4 != 0)
+        return QByteArray();
+
+    const int count = data.size() / 4;
+    const uchar *in = reinterpret_cast<const uchar*>(data.constData());
+
+    // Not null, also when there is no data
+    QByteArray out(0, '\0');
+
+    switch (method) {
+    case RowDelta: {
+        out = data;
+        uchar *values = reinterpret_cast<uchar*>(out.data());
+        if (rowLength > 0)
+            for (int i = rowLength; i < count; ++i)
+                setValueAt(values, i, valueAt(values, i) +
+                           valueAt(values, i - rowLength));
+        break;
+    }
+    case RunLength: {
+        if (count % 2 != 0)
+            return QByteArray();
+
+        // Determine the size first, to check it and allocate only once
+        qint64 size = 0;
+        for (int i = 0; i < count; i += 2)
+            size += qint64(valueAt(in, i)) * 4;
+        if (size > maximumSize)
+            return QByteArray();
+
+        out.resize(int(size));
+        uchar *values = reinterpret_cast<uchar*>(out.data());
+        int index = 0;
+        for (int i = 0; i < count; i += 2) {
+            const quint32 runLength = valueAt(in, i);
+            const quint32 value = valueAt(in, i + 1);
+            for (quint32 j = 0; j < runLength; ++j)
+                setValueAt(values, index++, value);
+        }
+        break;
+    }
+    case ByteShuffle: {
+        out.resize(data.size());
+        uchar *values = reinterpret_cast<uchar*>(out.data());
+        for (int i = 0; i < count; ++i)
+            for (int byte = 0; byte < 4; ++byte)
+                values[i * 4 + byte] = in[byte * count + i];
+        break;
+    }
+    }
+
+    return out;
+}
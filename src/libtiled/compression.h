@@ -37,35 +37,102 @@ namespace Tiled {
 
 enum CompressionMethod {
     Gzip,
-    Zlib
+    Zlib,
+    Zstandard,
+    LZ4
 };
 
 /**
- * Decompresses either zlib or gzip compressed memory. Returns a null
+ * The strategies that can be used when compressing with gzip or zlib. They
+ * correspond to the strategies supported by zlib's deflate.
+ */
+enum CompressionStrategy {
+    DefaultStrategy,
+    FilteredStrategy,
+    HuffmanOnlyStrategy,
+    RunLengthStrategy,  ///< Only finds runs, often suits tile data well
+    FixedStrategy
+};
+
+/**
+ * Returns whether the given compression method is available. Gzip and zlib
+ * are always available, while Zstandard and LZ4 depend on whether libtiled
+ * was built with "CONFIG+=zstd" and "CONFIG+=lz4" respectively.
+ */
+bool TILEDSHARED_EXPORT isCompressionMethodSupported(CompressionMethod method);
+
+/**
+ * Decompresses memory compressed with the given method. Returns a null
  * QByteArray if decompressing failed.
  *
  * Needed because qUncompress does not support gzip compressed data. Also,
  * this method does not need the expected size to be prepended to the data,
  * but it can be passed as optional parameter.
  *
+ * Gzip and zlib compressed data is detected automatically, so either of
+ * them can be passed for both.
+ *
  * @param data         the compressed data
  * @param expectedSize the expected size of the uncompressed data in bytes
+ * @param method       the method the data was compressed with
  * @return the uncompressed data, or a null QByteArray if decompressing failed
  */
 QByteArray TILEDSHARED_EXPORT decompress(const QByteArray &data,
-                                         int expectedSize = 1024);
+                                         int expectedSize = 1024,
+                                         CompressionMethod method = Zlib);
 
 /**
- * Compresses the give data in either gzip or zlib format. Returns a null
+ * Compresses the give data with the given method. Returns a null
  * QByteArray if compression failed.
  *
  * Needed because qCompress does not support gzip compression.
  *
- * @param data the uncompressed data
+ * @param data     the uncompressed data
+ * @param level    the compression level, or -1 for the default level of the
+ *                 method. Gzip and zlib support levels 0 to 9, Zstandard
+ *                 supports levels 1 to 22 and LZ4 uses its high compression
+ *                 mode for levels above 2.
+ * @param strategy the strategy used for gzip and zlib compression
  * @return the compressed data, or a null QByteArray if compression failed
  */
 QByteArray TILEDSHARED_EXPORT compress(const QByteArray &data,
-                                       CompressionMethod method = Zlib);
+                                       CompressionMethod method = Zlib,
+                                       int level = -1,
+                                       CompressionStrategy strategy =
+                                               DefaultStrategy);
+
+/**
+ * Filters that can be applied to arrays of little-endian 32-bit values, like
+ * global tile IDs, before compressing them. They expose the redundancy in
+ * tile layer data to the compression method.
+ */
+enum FilterMethod {
+    RowDelta,   ///< Replaces values by their difference to the row above
+    RunLength,  ///< Stores runs of equal values as (count, value) pairs
+    ByteShuffle ///< Groups the n-th bytes of all values together
+};
+
+/**
+ * Applies the given filter to \a data, an array of little-endian 32-bit
+ * values arranged in rows of \a rowLength values.
+ *
+ * @return the filtered data, or a null QByteArray when the size of the data
+ *         is not a multiple of 4 bytes
+ */
+QByteArray TILEDSHARED_EXPORT filter(const QByteArray &data,
+                                     FilterMethod method,
+                                     int rowLength);
+
+/**
+ * Reverses filter(). The \a maximumSize limits the size of the data
+ * restored by the RunLength filter.
+ *
+ * @return the unfiltered data, or a null QByteArray when the data is invalid
+ */
+QByteArray TILEDSHARED_EXPORT unfilter(const QByteArray &data,
+                                       FilterMethod method,
+                                       int rowLength,
+                                       int maximumSize);
 
 } // namespace Tiled
 
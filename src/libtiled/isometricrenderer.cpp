@@ -33,6 +33,8 @@
 #include "tile.h"
 #include "tilelayer.h"
 
+#include <QBitArray>
+
 #include <cmath>
 
 using namespace Tiled;
@@ -62,20 +64,18 @@ QRect IsometricRenderer::boundingRect(const QRect &rect) const
     return QRect(pos, size);
 }
 
-QRectF IsometricRenderer::boundingRect(const MapObject *object) const
+QRectF IsometricRenderer::objectBoundingRect(const MapObject *object) const
 {
     if (object->tile()) {
         const QPointF bottomCenter = tileToPixelCoords(object->position());
-        const QImage img = object->toImage();
+        const QImage img = objectImage(object);
         return QRectF(bottomCenter.x() - img.width() / 2,
                       bottomCenter.y() - img.height(),
                       img.width(),
                       img.height()).adjusted(-1, -1, 1, 1);
     } else if (!object->polygon().isEmpty()) {
-        const QPointF &pos = object->position();
-        const QPolygonF polygon = object->polygon().translated(pos);
-        const QPolygonF screenPolygon = tileToPixelCoords(polygon);
-        return screenPolygon.boundingRect().adjusted(-2, -2, 3, 3);
+        const QRectF polygonRect = screenPolygon(object).boundingRect();
+        return polygonRect.adjusted(-2, -2, 3, 3);
     } else {
         // Take the bounding rect of the projected object, and then add a few
         // pixels on all sides to correct for the line width.
@@ -84,7 +84,7 @@ QRectF IsometricRenderer::boundingRect(const MapObject *object) const
     }
 }
 
-QPainterPath IsometricRenderer::shape(const MapObject *object) const
+QPainterPath IsometricRenderer::objectShape(const MapObject *object) const
 {
     QPainterPath path;
     if (object->tile()) {
@@ -96,9 +96,7 @@ QPainterPath IsometricRenderer::shape(const MapObject *object) const
             break;
         case MapObject::Polygon:
         case MapObject::Polyline: {
-            const QPointF &pos = object->position();
-            const QPolygonF polygon = object->polygon().translated(pos);
-            const QPolygonF screenPolygon = tileToPixelCoords(polygon);
+            const QPolygonF &screenPolygon = this->screenPolygon(object);
             if (object->shape() == MapObject::Polygon) {
                 path.addPolygon(screenPolygon);
             } else {
@@ -138,21 +136,26 @@ void IsometricRenderer::drawGrid(QPainter *painter, const QRectF &rect) const
     gridPen.setDashPattern(QVector<qreal>() << 2 << 2);
     painter->setPen(gridPen);
 
+    // Draw all lines in a single call, to avoid the per-line overhead
+    QVector<QLineF> lines;
+    lines.reserve(qMax(0, endY - startY + 1) + qMax(0, endX - startX + 1));
+
     for (int y = startY; y <= endY; ++y) {
-        const QPointF start = tileToPixelCoords(startX, y);
-        const QPointF end = tileToPixelCoords(endX, y);
-        painter->drawLine(start, end);
+        lines.append(QLineF(tileToPixelCoords(startX, y),
+                            tileToPixelCoords(endX, y)));
     }
     for (int x = startX; x <= endX; ++x) {
-        const QPointF start = tileToPixelCoords(x, startY);
-        const QPointF end = tileToPixelCoords(x, endY);
-        painter->drawLine(start, end);
+        lines.append(QLineF(tileToPixelCoords(x, startY),
+                            tileToPixelCoords(x, endY)));
     }
+
+    painter->drawLines(lines);
 }
 
 void IsometricRenderer::drawTileLayer(QPainter *painter,
                                       const TileLayer *layer,
-                                      const QRectF &exposed) const
+                                      const QRectF &exposed,
+                                      const QBitArray *coveredCells) const
 {
     const int tileWidth = map()->tileWidth();
     const int tileHeight = map()->tileHeight();
@@ -202,6 +205,8 @@ void IsometricRenderer::drawTileLayer(QPainter *painter,
     // Determine whether the current row is shifted half a tile to the right
     bool shifted = inUpperHalf ^ inLeftHalf;
 
+    CellRenderer renderer(painter);
+
     for (int y = startPos.y(); y - tileHeight < rect.bottom();
          y += tileHeight / 2)
     {
@@ -210,11 +215,10 @@ void IsometricRenderer::drawTileLayer(QPainter *painter,
         for (int x = startPos.x(); x < rect.right(); x += tileWidth) {
             if (layer->contains(columnItr)) {
                 const Cell &cell = layer->cellAt(columnItr);
-                if (!cell.isEmpty()) {
-                    const QImage qimg = cell.toImage();
-                    const QPoint qpos(x, y - qimg.height());
-                    painter->drawImage(qpos, qimg);
-                }
+                const bool covered = coveredCells && coveredCells->testBit(
+                            columnItr.x() + columnItr.y() * layer->width());
+                if (!cell.isEmpty() && !covered)
+                    renderer.render(cell, QPointF(x, y));
             }
 
             // Advance to the next column
@@ -249,6 +253,29 @@ void IsometricRenderer::drawTileSelection(QPainter *painter,
     }
 }
 
+void IsometricRenderer::drawTileMask(QPainter *painter,
+                                     const QImage &mask,
+                                     const QPoint &pos,
+                                     const QRectF &) const
+{
+    const int tileWidth = map()->tileWidth();
+    const int tileHeight = map()->tileHeight();
+    const QPointF origin = tileToPixelCoords(0, 0);
+
+    // Maps tile coordinates to pixel coordinates, like tileToPixelCoords()
+    const QTransform tileToPixel(tileWidth / 2.0, tileHeight / 2.0,
+                                 -tileWidth / 2.0, tileHeight / 2.0,
+                                 origin.x(), origin.y());
+
+    // Since the mask is drawn transformed, the painter takes care of
+    // skipping the parts that are not exposed
+    painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter->setTransform(tileToPixel, true);
+    painter->drawImage(pos, mask);
+    painter->restore();
+}
+
 void IsometricRenderer::drawMapObject(QPainter *painter,
                                       const MapObject *object,
                                       const QColor &color) const
@@ -266,7 +293,7 @@ void IsometricRenderer::drawMapObjectDecorate(QPainter *painter,
     QPen pen(Qt::black);
 
     if (object->tile()) {
-        const QImage img = object->toImage();
+        const QImage img = objectImage(object);
         QPointF paintOrigin(-img.width() / 2, -img.height());
         paintOrigin += tileToPixelCoords(object->position()).toPoint();
         painter->drawImage(paintOrigin, img);
@@ -310,9 +337,7 @@ void IsometricRenderer::drawMapObjectDecorate(QPainter *painter,
             break;
         }
         case MapObject::Polygon: {
-            const QPointF &pos = object->position();
-            const QPolygonF polygon = object->polygon().translated(pos);
-            QPolygonF screenPolygon = tileToPixelCoords(polygon);
+            QPolygonF screenPolygon = this->screenPolygon(object);
 
             painter->drawPolygon(screenPolygon);
 
@@ -325,9 +350,7 @@ void IsometricRenderer::drawMapObjectDecorate(QPainter *painter,
             break;
         }
         case MapObject::Polyline: {
-            const QPointF &pos = object->position();
-            const QPolygonF polygon = object->polygon().translated(pos);
-            QPolygonF screenPolygon = tileToPixelCoords(polygon);
+            QPolygonF screenPolygon = this->screenPolygon(object);
 
             painter->drawPolyline(screenPolygon);
 
@@ -47,21 +47,25 @@ public:
 
     QSize mapSize() const;
 
+    using MapRenderer::boundingRect;
     QRect boundingRect(const QRect &rect) const;
 
-    QRectF boundingRect(const MapObject *object) const;
-    QPainterPath shape(const MapObject *object) const;
-
     void drawGrid(QPainter *painter, const QRectF &rect) const;
 
     void drawTileLayer(QPainter *painter, const TileLayer *layer,
-                       const QRectF &exposed = QRectF()) const;
+                       const QRectF &exposed = QRectF(),
+                       const QBitArray *coveredCells = 0) const;
 
     void drawTileSelection(QPainter *painter,
                            const QRegion &region,
                            const QColor &color,
                            const QRectF &exposed) const;
 
+    void drawTileMask(QPainter *painter,
+                      const QImage &mask,
+                      const QPoint &pos,
+                      const QRectF &exposed) const;
+
     void drawMapObject(QPainter *painter,
                        const MapObject *object,
                        const QColor &color) const;
@@ -77,6 +81,10 @@ public:
     using MapRenderer::tileToPixelCoords;
     QPointF tileToPixelCoords(qreal x, qreal y) const;
 
+protected:
+    QRectF objectBoundingRect(const MapObject *object) const;
+    QPainterPath objectShape(const MapObject *object) const;
+
 private:
     QPolygonF tileRectToPolygon(const QRect &rect) const;
     QPolygonF tileRectToPolygon(const QRectF &rect) const;
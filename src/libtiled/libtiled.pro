@@ -15,12 +15,24 @@ DLLDESTDIR = ../..
 win32:INCLUDEPATH += $$(QTDIR)/src/3rdparty/zlib
 else:LIBS += -lz
 
+# Optional layer data compression methods, enabled with CONFIG+=zstd and
+# CONFIG+=lz4 respectively
+zstd {
+    DEFINES += TILED_ZSTD_SUPPORT
+    LIBS += -lzstd
+}
+lz4 {
+    DEFINES += TILED_LZ4_SUPPORT
+    LIBS += -llz4
+}
+
 DEFINES += QT_NO_CAST_FROM_ASCII \
     QT_NO_CAST_TO_ASCII
 DEFINES += TILED_LIBRARY
 contains(QT_CONFIG, reduce_exports): CONFIG += hide_symbols
 OBJECTS_DIR = .obj
-SOURCES += compression.cpp \
+SOURCES += binarymap.cpp \
+    compression.cpp \
     isometricrenderer.cpp \
     layer.cpp \
     map.cpp \
@@ -29,12 +41,17 @@ SOURCES += compression.cpp \
     maprenderer.cpp \
     mapwriter.cpp \
     objectgroup.cpp \
+    occlusionculler.cpp \
     orthogonalrenderer.cpp \
+    pngstreamwriter.cpp \
     properties.cpp \
+    solidrectangles.cpp \
     tilelayer.cpp \
     tileset.cpp \
+    tilesetcache.cpp \
     gidmapper.cpp
-HEADERS += compression.h \
+HEADERS += binarymap.h \
+    compression.h \
     isometricrenderer.h \
     layer.h \
     map.h \
@@ -44,12 +61,16 @@ HEADERS += compression.h \
     mapwriter.h \
     object.h \
     objectgroup.h \
+    occlusionculler.h \
     orthogonalrenderer.h \
+    pngstreamwriter.h \
     properties.h \
+    solidrectangles.h \
     tile.h \
     tiled_global.h \
     tilelayer.h \
     tileset.h \
+    tilesetcache.h \
     gidmapper.h
 macx {
     contains(QT_CONFIG, ppc):CONFIG += x86 \
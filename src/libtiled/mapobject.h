@@ -34,6 +34,8 @@
 #include "object.h"
 #include "tilelayer.h"
 
+#include <QImage>
+#include <QPainterPath>
 #include <QPolygonF>
 #include <QSizeF>
 #include <QString>
@@ -41,6 +43,7 @@
 
 namespace Tiled {
 
+class MapRenderer;
 class ObjectGroup;
 class Tile;
 
@@ -93,7 +96,7 @@ public:
     /**
      * Sets the name of this object.
      */
-    void setName(const QString &name) { mName = name; }
+    void setName(const QString &name) { mName = name; invalidateGeometry(); }
 
     /**
      * Returns the type of this object. The type usually says something about
@@ -114,7 +117,7 @@ public:
     /**
      * Sets the position of this object.
      */
-    void setPosition(const QPointF &pos) { mPos = pos; }
+    void setPosition(const QPointF &pos) { mPos = pos; invalidateGeometry(); }
 
     /**
      * Returns the x position of this object.
@@ -124,7 +127,7 @@ public:
     /**
      * Sets the x position of this object.
      */
-    void setX(qreal x) { mPos.setX(x); }
+    void setX(qreal x) { mPos.setX(x); invalidateGeometry(); }
 
     /**
      * Returns the y position of this object.
@@ -134,7 +137,7 @@ public:
     /**
      * Sets the x position of this object.
      */
-    void setY(qreal y) { mPos.setY(y); }
+    void setY(qreal y) { mPos.setY(y); invalidateGeometry(); }
 
     /**
      * Returns the size of this object.
@@ -144,7 +147,7 @@ public:
     /**
      * Sets the size of this object.
      */
-    void setSize(const QSizeF &size) { mSize = size; }
+    void setSize(const QSizeF &size) { mSize = size; invalidateGeometry(); }
 
     void setSize(qreal width, qreal height)
     { setSize(QSizeF(width, height)); }
@@ -157,7 +160,8 @@ public:
     /**
      * Sets the width of this object.
      */
-    void setWidth(qreal width) { mSize.setWidth(width); }
+    void setWidth(qreal width)
+    { mSize.setWidth(width); invalidateGeometry(); }
 
     /**
      * Returns the height of this object.
@@ -167,7 +171,8 @@ public:
     /**
      * Sets the height of this object.
      */
-    void setHeight(qreal height) { mSize.setHeight(height); }
+    void setHeight(qreal height)
+    { mSize.setHeight(height); invalidateGeometry(); }
 
     /**
      * Sets the polygon associated with this object. The polygon is only used
@@ -175,7 +180,8 @@ public:
      *
      * \sa setShape()
      */
-    void setPolygon(const QPolygonF &polygon) { mPolygon = polygon; }
+    void setPolygon(const QPolygonF &polygon)
+    { mPolygon = polygon; invalidateGeometry(); }
 
     /**
      * Returns the polygon associated with this object. Returns an empty
@@ -186,7 +192,7 @@ public:
     /**
      * Sets the shape of the object.
      */
-    void setShape(Shape shape) { mShape = shape; }
+    void setShape(Shape shape) { mShape = shape; invalidateGeometry(); }
 
     /**
      * Returns the shape of the object.
@@ -204,7 +210,7 @@ public:
      *
      * \warning The object shape is ignored for tile objects!
      */
-    void setTile(Tile *tile) { mCell.tile = tile; }
+    void setTile(Tile *tile) { mCell.tile = tile; invalidateImage(); }
 
     /**
      * Returns the tile associated with this object.
@@ -235,31 +241,37 @@ public:
     inline void setFlipHorizontally(bool flip)
     {
         mCell.flippedHorizontally = flip;
+        invalidateImage();
     }
 
     inline void setFlipVertically(bool flip)
     {
         mCell.flippedVertically = flip;
+        invalidateImage();
     }
 
     inline void toggleFlipHorizontal()
     {
         mCell.toggleFlipHorizontal();
+        invalidateImage();
     }
 
     inline void toggleFlipVertical()
     {
         mCell.toggleFlipVertical();
+        invalidateImage();
     }
 
     inline void setRotation(qint32 steps)
     {
         mCell.setRotation(steps);
+        invalidateImage();
     }
 
     inline void incrementRotation()
     {
         mCell.incrementRotation();
+        invalidateImage();
     }
 
     inline QImage toImage() const
@@ -269,8 +281,53 @@ public:
 
     Cell getCell() const { return mCell; }
 
-
 private:
+    friend class MapRenderer;
+
+    void invalidateGeometry()
+    { mRenderCache.renderer = 0; }
+
+    void invalidateImage()
+    { mRenderCache.renderer = 0; mRenderCache.hasImage = false; }
+
+    /**
+     * Geometry and image of the object as computed by a map renderer. It is
+     * kept with the object, since views keep asking for it, and dropped by
+     * the functions that change the object.
+     *
+     * \sa MapRenderer::boundingRect(), MapRenderer::shape()
+     */
+    struct RenderCache
+    {
+        RenderCache()
+            : renderer(0)
+            , tileImageKey(0)
+            , hasBoundingRect(false)
+            , hasShape(false)
+            , hasScreenPolygon(false)
+            , imageKey(0)
+            , hasImage(false)
+        {}
+
+        // What the geometry was computed for
+        const MapRenderer *renderer;
+        QSize tileSize;
+        QSize mapSize;
+        qint64 tileImageKey;
+
+        QRectF boundingRect;
+        QPainterPath shape;
+        QPolygonF screenPolygon;
+        bool hasBoundingRect;
+        bool hasShape;
+        bool hasScreenPolygon;
+
+        // The flipped and rotated tile image, see toImage()
+        QImage image;
+        qint64 imageKey;
+        bool hasImage;
+    };
+
     QString mName;
     QString mType;
     QPointF mPos;
@@ -279,6 +336,7 @@ private:
     Shape mShape;
     Cell mCell;
     ObjectGroup *mObjectGroup;
+    mutable RenderCache mRenderCache;
 };
 
 } // namespace Tiled
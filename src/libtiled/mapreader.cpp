@@ -38,12 +38,18 @@
 #include "tile.h"
 #include "tilelayer.h"
 #include "tileset.h"
+#include "tilesetcache.h"
 
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
+#include <QFuture>
+#include <QStringList>
 #include <QXmlStreamReader>
+#include <QtConcurrentRun>
+
+#include <climits>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -51,15 +57,90 @@ using namespace Tiled::Internal;
 namespace Tiled {
 namespace Internal {
 
+/**
+ * Decodes base64 and CSV encoded tile layer data. Used while the map is being
+ * read, or later on when decoding of the layer data was deferred.
+ */
+class LayerDataDecoder
+{
+    Q_DECLARE_TR_FUNCTIONS(MapReader)
+
+public:
+    LayerDataDecoder(const GidMapper &gidMapper):
+        mGidMapper(gidMapper)
+    {}
+
+    /**
+     * Decodes the given base64 encoded, optionally compressed, layer data
+     * into the \a area of the tile layer.
+     * Returns false and sets errorString() when decoding failed.
+     */
+    bool decodeBinary(TileLayer *tileLayer, const QRect &area,
+                      const QByteArray &latin1Text,
+                      const QString &compression);
+
+    /**
+     * Decodes the CSV layer data in the range [\a begin, \a end) into the
+     * \a area of the tile layer.
+     * Returns false and sets errorString() when decoding failed.
+     */
+    bool decodeCSV(TileLayer *tileLayer, const QRect &area,
+                   const QChar *begin, const QChar *end);
+
+    const QString &errorString() const { return mError; }
+
+private:
+    bool cellForGid(uint gid, Cell &cell);
+
+    const GidMapper &mGidMapper;
+    QString mError;
+};
+
+/**
+ * Keeps the encoded data of a tile layer around until the layer is first
+ * accessed. The data can consist of several chunks.
+ */
+class DeferredLayerData : public TileLayerDecoder
+{
+public:
+    DeferredLayerData(const GidMapper &gidMapper):
+        mGidMapper(gidMapper)
+    {}
+
+    void addBinaryChunk(const QRect &area,
+                        const QByteArray &latin1Text,
+                        const QString &compression);
+    void addCSVChunk(const QRect &area, const QString &csvText);
+
+    bool isEmpty() const { return mChunks.isEmpty(); }
+
+    bool decode(TileLayer *tileLayer, QString *error);
+
+private:
+    struct Chunk {
+        QRect area;
+        QByteArray latin1Text;
+        QString compression;
+        QString csvText;
+        bool csv;
+    };
+
+    const GidMapper mGidMapper;
+    QList<Chunk> mChunks;
+};
+
 class MapReaderPrivate
 {
     Q_DECLARE_TR_FUNCTIONS(MapReader)
 
 public:
     MapReaderPrivate(MapReader *mapReader):
+        mLayerDecodingDeferred(false),
+        mTilesetCache(0),
         p(mapReader),
         mMap(0),
-        mReadingExternalTileset(false)
+        mReadingExternalTileset(false),
+        mDeferredLayerData(0)
     {}
 
     Map *readMap(QIODevice *device, const QString &path);
@@ -69,6 +150,9 @@ public:
 
     QString errorString() const;
 
+    bool mLayerDecodingDeferred;
+    TilesetCache *mTilesetCache;
+
 private:
     void readUnknownElement();
 
@@ -78,12 +162,27 @@ private:
     void readTilesetTile(Tileset *tileset);
     void readTilesetImage(Tileset *tileset);
 
+    /**
+     * Waits for all tileset images that are still being decoded and loads
+     * the tiles from them. Called before the first tile is resolved and at
+     * the end of reading a map or tileset.
+     */
+    void finishTilesetImages();
+
     TileLayer *readLayer();
     void readLayerData(TileLayer *tileLayer);
-    void decodeBinaryLayerData(TileLayer *tileLayer,
+    void readLayerDataChunk(TileLayer *tileLayer,
+                            const QStringRef &encoding,
+                            const QStringRef &compression);
+    void decodeLayerData(TileLayer *tileLayer, const QRect &area,
+                         const QStringRef &text,
+                         const QStringRef &encoding,
+                         const QStringRef &compression);
+    void decodeBinaryLayerData(TileLayer *tileLayer, const QRect &area,
                                const QStringRef &text,
                                const QStringRef &compression);
-    void decodeCSVLayerData(TileLayer *tileLayer, const QString &text);
+    void decodeCSVLayerData(TileLayer *tileLayer, const QRect &area,
+                            const QStringRef &text);
 
     /**
      * Returns the cell for the given global tile ID. Errors are raised with
@@ -110,6 +209,25 @@ private:
     GidMapper mGidMapper;
     bool mReadingExternalTileset;
 
+    QRect mRegion;                          // Area to read, or null for all
+    DeferredLayerData *mDeferredLayerData;  // For the current layer
+
+    /**
+     * A tileset image that is being decoded in the background. The tile
+     * properties encountered before the image is done are kept around, since
+     * the tiles they apply to don't exist yet.
+     */
+    struct PendingTilesetImage {
+        Tileset *tileset;
+        QString source;
+        QFuture<QImage> image;
+        QList<QPair<int, Properties> > tileProperties;
+    };
+
+    PendingTilesetImage *pendingImageFor(Tileset *tileset);
+
+    QList<PendingTilesetImage> mPendingImages;
+
     QXmlStreamReader xml;
 };
 
@@ -130,6 +248,7 @@ Map *MapReaderPrivate::readMap(QIODevice *device, const QString &path)
         xml.raiseError(tr("Not a map file."));
     }
 
+    finishTilesetImages();
     mGidMapper.clear();
     return map;
 }
@@ -148,6 +267,7 @@ Tileset *MapReaderPrivate::readTileset(QIODevice *device, const QString &path)
     else
         xml.raiseError(tr("Not a tileset file."));
 
+    finishTilesetImages();
     mReadingExternalTileset = false;
     return tileset;
 }
@@ -183,6 +303,75 @@ void MapReaderPrivate::readUnknownElement()
     xml.skipCurrentElement();
 }
 
+/**
+ * Parses a decimal number straight from the characters in [\a c, \a end).
+ * This avoids the temporary QString that would be allocated by converting an
+ * attribute value to a string first, which adds up for maps with many
+ * objects or CSV encoded layers.
+ *
+ * Accepts the same input as QString::toLongLong(): an optional sign and
+ * digits, surrounded by optional whitespace. Returns 0 and sets \a ok to
+ * false when the text is not a number or is out of the range
+ * [\a min, \a max].
+ */
+static qint64 parseInteger(const QChar *c, const QChar *end,
+                           qint64 min, qint64 max, bool *ok)
+{
+    while (c != end && c->isSpace())
+        ++c;
+
+    bool negative = false;
+    if (c != end && (*c == QLatin1Char('-') || *c == QLatin1Char('+'))) {
+        negative = *c == QLatin1Char('-');
+        ++c;
+    }
+
+    const QChar *digitsStart = c;
+    const qint64 limit = negative ? -min : max;
+    qint64 value = 0;
+
+    while (c != end && c->unicode() >= '0' && c->unicode() <= '9') {
+        value = value * 10 + (c->unicode() - '0');
+        if (value > limit)
+            break;
+        ++c;
+    }
+
+    const bool hasDigits = c != digitsStart;
+
+    while (c != end && c->isSpace())
+        ++c;
+
+    const bool valid = hasDigits && c == end && value <= limit;
+    if (ok)
+        *ok = valid;
+
+    if (!valid)
+        return 0;
+
+    return negative ? -value : value;
+}
+
+static int intValue(const QChar *c, const QChar *end, bool *ok = 0)
+{
+    return int(parseInteger(c, end, INT_MIN, INT_MAX, ok));
+}
+
+static uint uintValue(const QChar *c, const QChar *end, bool *ok = 0)
+{
+    return uint(parseInteger(c, end, 0, UINT_MAX, ok));
+}
+
+static int intValue(const QStringRef &ref, bool *ok = 0)
+{
+    return intValue(ref.unicode(), ref.unicode() + ref.size(), ok);
+}
+
+static uint uintValue(const QStringRef &ref, bool *ok = 0)
+{
+    return uintValue(ref.unicode(), ref.unicode() + ref.size(), ok);
+}
+
 static Map::Orientation orientationFromString(const QStringRef &string)
 {
     Map::Orientation orientation = Map::Unknown;
@@ -200,13 +389,13 @@ Map *MapReaderPrivate::readMap()
 
     const QXmlStreamAttributes atts = xml.attributes();
     const int mapWidth =
-            atts.value(QLatin1String("width")).toString().toInt();
+            intValue(atts.value(QLatin1String("width")));
     const int mapHeight =
-            atts.value(QLatin1String("height")).toString().toInt();
+            intValue(atts.value(QLatin1String("height")));
     const int tileWidth =
-            atts.value(QLatin1String("tilewidth")).toString().toInt();
+            intValue(atts.value(QLatin1String("tilewidth")));
     const int tileHeight =
-            atts.value(QLatin1String("tileheight")).toString().toInt();
+            intValue(atts.value(QLatin1String("tileheight")));
 
     const QStringRef orientationRef =
             atts.value(QLatin1String("orientation"));
@@ -233,10 +422,16 @@ Map *MapReaderPrivate::readMap()
             readUnknownElement();
     }
 
+    // Tileset images that were not needed by any tile are loaded here
+    finishTilesetImages();
+
     // Clean up in case of error
     if (xml.hasError()) {
-        // The tilesets are not owned by the map
-        qDeleteAll(mMap->tilesets());
+        // The tilesets are not owned by the map, but they may be owned by
+        // the tileset cache
+        foreach (Tileset *tileset, mMap->tilesets())
+            if (!mTilesetCache || !mTilesetCache->contains(tileset))
+                delete tileset;
 
         delete mMap;
         mMap = 0;
@@ -252,7 +447,7 @@ Tileset *MapReaderPrivate::readTileset()
     const QXmlStreamAttributes atts = xml.attributes();
     const QString source = atts.value(QLatin1String("source")).toString();
     const uint firstGid =
-            atts.value(QLatin1String("firstgid")).toString().toUInt();
+            uintValue(atts.value(QLatin1String("firstgid")));
 
     Tileset *tileset = 0;
 
@@ -260,13 +455,13 @@ Tileset *MapReaderPrivate::readTileset()
         const QString name =
                 atts.value(QLatin1String("name")).toString();
         const int tileWidth =
-                atts.value(QLatin1String("tilewidth")).toString().toInt();
+                intValue(atts.value(QLatin1String("tilewidth")));
         const int tileHeight =
-                atts.value(QLatin1String("tileheight")).toString().toInt();
+                intValue(atts.value(QLatin1String("tileheight")));
         const int tileSpacing =
-                atts.value(QLatin1String("spacing")).toString().toInt();
+                intValue(atts.value(QLatin1String("spacing")));
         const int margin =
-                atts.value(QLatin1String("margin")).toString().toInt();
+                intValue(atts.value(QLatin1String("margin")));
 
         if (tileWidth <= 0 || tileHeight <= 0
             || (firstGid == 0 && !mReadingExternalTileset)) {
@@ -311,9 +506,13 @@ void MapReaderPrivate::readTilesetTile(Tileset *tileset)
     Q_ASSERT(xml.isStartElement() && xml.name() == "tile");
 
     const QXmlStreamAttributes atts = xml.attributes();
-    const int id = atts.value(QLatin1String("id")).toString().toInt();
+    const int id = intValue(atts.value(QLatin1String("id")));
+
+    // While the tileset image is still being decoded, the tile count is not
+    // known yet. The ID is checked once the tiles have been created.
+    PendingTilesetImage *pending = pendingImageFor(tileset);
 
-    if (id < 0 || id >= tileset->tileCount()) {
+    if (id < 0 || (!pending && id >= tileset->tileCount())) {
         xml.raiseError(tr("Invalid tile ID: %1").arg(id));
         return;
     }
@@ -322,8 +521,13 @@ void MapReaderPrivate::readTilesetTile(Tileset *tileset)
 
     while (xml.readNextStartElement()) {
         if (xml.name() == "properties") {
-            Tile *tile = tileset->tileAt(id);
-            tile->mergeProperties(readProperties());
+            if (pending) {
+                pending->tileProperties.append(qMakePair(id,
+                                                         readProperties()));
+            } else {
+                Tile *tile = tileset->tileAt(id);
+                tile->mergeProperties(readProperties());
+            }
         } else {
             readUnknownElement();
         }
@@ -347,16 +551,61 @@ void MapReaderPrivate::readTilesetImage(Tileset *tileset)
     source = p->resolveReference(source, mPath);
 
     // Set the width that the tileset had when the map was saved
-    const int width = atts.value(QLatin1String("width")).toString().toInt();
+    const int width = intValue(atts.value(QLatin1String("width")));
     mGidMapper.setTilesetWidth(tileset, width);
 
-    const QImage tilesetImage = p->readExternalImage(source);
-    if (!tileset->loadFromImage(tilesetImage, source))
-        xml.raiseError(tr("Error loading tileset image:\n'%1'").arg(source));
+    // Decode the image in the background, so that the rest of the file can
+    // be parsed meanwhile. The tiles are created by finishTilesetImages().
+    PendingTilesetImage pending;
+    pending.tileset = tileset;
+    pending.source = source;
+    pending.image = QtConcurrent::run(p, &MapReader::readExternalImage,
+                                      source);
+    mPendingImages.append(pending);
 
     xml.skipCurrentElement();
 }
 
+MapReaderPrivate::PendingTilesetImage *
+MapReaderPrivate::pendingImageFor(Tileset *tileset)
+{
+    for (int i = 0; i < mPendingImages.size(); ++i)
+        if (mPendingImages.at(i).tileset == tileset)
+            return &mPendingImages[i];
+    return 0;
+}
+
+void MapReaderPrivate::finishTilesetImages()
+{
+    // Take the list first, since raising an error below must not lead back
+    // in here
+    const QList<PendingTilesetImage> pendingImages = mPendingImages;
+    mPendingImages.clear();
+
+    foreach (const PendingTilesetImage &pending, pendingImages) {
+        Tileset *tileset = pending.tileset;
+        const QImage tilesetImage = pending.image.result();
+
+        // Tiles can only be created on the thread owning the pixmaps
+        if (!tileset->loadFromImage(tilesetImage, pending.source)) {
+            xml.raiseError(tr("Error loading tileset image:\n'%1'")
+                           .arg(pending.source));
+            continue;
+        }
+
+        typedef QPair<int, Properties> TileProperties;
+        foreach (const TileProperties &tileProperties,
+                 pending.tileProperties) {
+            const int id = tileProperties.first;
+            if (id >= tileset->tileCount()) {
+                xml.raiseError(tr("Invalid tile ID: %1").arg(id));
+                break;
+            }
+            tileset->tileAt(id)->mergeProperties(tileProperties.second);
+        }
+    }
+}
+
 static void readLayerAttributes(Layer *layer,
                                 const QXmlStreamAttributes &atts)
 {
@@ -368,7 +617,7 @@ static void readLayerAttributes(Layer *layer,
     if (ok)
         layer->setOpacity(opacity);
 
-    const int visible = visibleRef.toString().toInt(&ok);
+    const int visible = intValue(visibleRef, &ok);
     if (ok)
         layer->setVisible(visible);
 }
@@ -379,10 +628,10 @@ TileLayer *MapReaderPrivate::readLayer()
 
     const QXmlStreamAttributes atts = xml.attributes();
     const QString name = atts.value(QLatin1String("name")).toString();
-    const int x = atts.value(QLatin1String("x")).toString().toInt();
-    const int y = atts.value(QLatin1String("y")).toString().toInt();
-    const int width = atts.value(QLatin1String("width")).toString().toInt();
-    const int height = atts.value(QLatin1String("height")).toString().toInt();
+    const int x = intValue(atts.value(QLatin1String("x")));
+    const int y = intValue(atts.value(QLatin1String("y")));
+    const int width = intValue(atts.value(QLatin1String("width")));
+    const int height = intValue(atts.value(QLatin1String("height")));
 
     TileLayer *tileLayer = new TileLayer(name, x, y, width, height);
     readLayerAttributes(tileLayer, atts);
@@ -407,6 +656,9 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
     QStringRef encoding = atts.value(QLatin1String("encoding"));
     QStringRef compression = atts.value(QLatin1String("compression"));
 
+    if (mLayerDecodingDeferred)
+        mDeferredLayerData = new DeferredLayerData(mGidMapper);
+
     int x = 0;
     int y = 0;
 
@@ -421,7 +673,7 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
                 }
 
                 const QXmlStreamAttributes atts = xml.attributes();
-                uint gid = atts.value(QLatin1String("gid")).toString().toUInt();
+                uint gid = uintValue(atts.value(QLatin1String("gid")));
                 tileLayer->setCell(x, y, cellForGid(gid));
 
                 x++;
@@ -431,57 +683,242 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
                 }
 
                 xml.skipCurrentElement();
+            } else if (xml.name() == QLatin1String("chunk")) {
+                readLayerDataChunk(tileLayer, encoding, compression);
             } else {
                 readUnknownElement();
             }
         } else if (xml.isCharacters() && !xml.isWhitespace()) {
-            if (encoding == QLatin1String("base64")) {
-                decodeBinaryLayerData(tileLayer,
-                                      xml.text(),
-                                      compression);
-            } else if (encoding == QLatin1String("csv")) {
-                decodeCSVLayerData(tileLayer, xml.text().toString());
-            } else {
-                xml.raiseError(tr("Unknown encoding: %1")
-                               .arg(encoding.toString()));
-                continue;
-            }
+            const QRect area(0, 0, tileLayer->width(), tileLayer->height());
+            decodeLayerData(tileLayer, area, xml.text(),
+                            encoding, compression);
         }
     }
+
+    if (mDeferredLayerData) {
+        if (!mDeferredLayerData->isEmpty())
+            tileLayer->setDeferredDecoder(mDeferredLayerData);
+        else
+            delete mDeferredLayerData;
+        mDeferredLayerData = 0;
+    }
+}
+
+void MapReaderPrivate::readLayerDataChunk(TileLayer *tileLayer,
+                                          const QStringRef &encoding,
+                                          const QStringRef &compression)
+{
+    Q_ASSERT(xml.isStartElement() && xml.name() == "chunk");
+
+    const QXmlStreamAttributes atts = xml.attributes();
+    const QRect area(intValue(atts.value(QLatin1String("x"))),
+                     intValue(atts.value(QLatin1String("y"))),
+                     intValue(atts.value(QLatin1String("width"))),
+                     intValue(atts.value(QLatin1String("height"))));
+
+    const QRect layerArea(0, 0, tileLayer->width(), tileLayer->height());
+    if (area.isEmpty() || !layerArea.contains(area)) {
+        xml.raiseError(tr("Invalid chunk in layer '%1'")
+                       .arg(tileLayer->name()));
+        return;
+    }
+
+    // Chunks outside of the requested region are not decoded at all
+    if (!mRegion.isNull()
+            && !mRegion.intersects(area.translated(tileLayer->position()))) {
+        xml.skipCurrentElement();
+        return;
+    }
+
+    const QString text = xml.readElementText();
+    if (!xml.hasError())
+        decodeLayerData(tileLayer, area, QStringRef(&text),
+                        encoding, compression);
+}
+
+void MapReaderPrivate::decodeLayerData(TileLayer *tileLayer,
+                                       const QRect &area,
+                                       const QStringRef &text,
+                                       const QStringRef &encoding,
+                                       const QStringRef &compression)
+{
+    if (encoding == QLatin1String("base64")) {
+        decodeBinaryLayerData(tileLayer, area, text, compression);
+    } else if (encoding == QLatin1String("csv")) {
+        decodeCSVLayerData(tileLayer, area, text);
+    } else {
+        xml.raiseError(tr("Unknown encoding: %1")
+                       .arg(encoding.toString()));
+    }
+}
+
+/**
+ * Determines the compression method with the given name. Returns false when
+ * the name is not known.
+ */
+static bool compressionMethod(const QString &compression,
+                              CompressionMethod *method)
+{
+    if (compression == QLatin1String("zlib"))
+        *method = Zlib;
+    else if (compression == QLatin1String("gzip"))
+        *method = Gzip;
+    else if (compression == QLatin1String("zstd"))
+        *method = Zstandard;
+    else if (compression == QLatin1String("lz4"))
+        *method = LZ4;
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * Determines the filter with the given name. Returns false when the name is
+ * not known.
+ */
+static bool filterMethod(const QString &name, FilterMethod *method)
+{
+    if (name == QLatin1String("delta"))
+        *method = RowDelta;
+    else if (name == QLatin1String("rle"))
+        *method = RunLength;
+    else if (name == QLatin1String("shuffle"))
+        *method = ByteShuffle;
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * Parses the compression attribute of the layer data. Besides a compression
+ * method, it may list the filters that were applied before compressing the
+ * data, in the order they were applied. For example "delta+shuffle+zlib".
+ *
+ * Returns false when any part is not known or not supported.
+ */
+static bool parseCompression(const QString &compression,
+                             QList<FilterMethod> *filters,
+                             bool *compressed,
+                             CompressionMethod *method)
+{
+    *compressed = false;
+
+    if (compression.isEmpty())
+        return true;
+
+    const QStringList parts = compression.split(QLatin1Char('+'));
+    for (int i = 0; i < parts.size(); ++i) {
+        FilterMethod filter;
+        if (filterMethod(parts.at(i), &filter)) {
+            filters->append(filter);
+        } else if (i == parts.size() - 1
+                   && compressionMethod(parts.at(i), method)
+                   && isCompressionMethodSupported(*method)) {
+            *compressed = true;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool isSupportedCompression(const QStringRef &compression)
+{
+    QList<FilterMethod> filters;
+    bool compressed;
+    CompressionMethod method;
+    return parseCompression(compression.toString(),
+                            &filters, &compressed, &method);
 }
 
 void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
+                                             const QRect &area,
                                              const QStringRef &text,
                                              const QStringRef &compression)
 {
+    if (!isSupportedCompression(compression)) {
+        xml.raiseError(tr("Compression method '%1' not supported")
+                       .arg(compression.toString()));
+        return;
+    }
+
 #if QT_VERSION < 0x040800
     const QString textData = QString::fromRawData(text.unicode(), text.size());
     const QByteArray latin1Text = textData.toLatin1();
 #else
     const QByteArray latin1Text = text.toLatin1();
 #endif
-    QByteArray tileData = QByteArray::fromBase64(latin1Text);
-    const int size = (tileLayer->width() * tileLayer->height()) * 4;
 
-    if (compression == QLatin1String("zlib")
-        || compression == QLatin1String("gzip")) {
-        tileData = decompress(tileData, size);
-    } else if (!compression.isEmpty()) {
-        xml.raiseError(tr("Compression method '%1' not supported")
-                       .arg(compression.toString()));
+    if (mDeferredLayerData) {
+        mDeferredLayerData->addBinaryChunk(area, latin1Text,
+                                           compression.toString());
         return;
     }
 
-    if (size != tileData.length()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
+    // Tiles can only be resolved once their tileset images are loaded
+    if (!mPendingImages.isEmpty())
+        finishTilesetImages();
+
+    LayerDataDecoder decoder(mGidMapper);
+    if (!decoder.decodeBinary(tileLayer, area,
+                              latin1Text, compression.toString()))
+        xml.raiseError(decoder.errorString());
+}
+
+void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer,
+                                          const QRect &area,
+                                          const QStringRef &text)
+{
+    if (mDeferredLayerData) {
+        mDeferredLayerData->addCSVChunk(area, text.toString());
         return;
     }
 
+    if (!mPendingImages.isEmpty())
+        finishTilesetImages();
+
+    LayerDataDecoder decoder(mGidMapper);
+    if (!decoder.decodeCSV(tileLayer, area,
+                           text.unicode(), text.unicode() + text.size()))
+        xml.raiseError(decoder.errorString());
+}
+
+bool LayerDataDecoder::decodeBinary(TileLayer *tileLayer, const QRect &area,
+                                    const QByteArray &latin1Text,
+                                    const QString &compression)
+{
+    QByteArray tileData = QByteArray::fromBase64(latin1Text);
+    const int size = (area.width() * area.height()) * 4;
+
+    QList<FilterMethod> filters;
+    bool compressed;
+    CompressionMethod method;
+    if (!parseCompression(compression, &filters, &compressed, &method)) {
+        mError = tr("Compression method '%1' not supported")
+                .arg(compression);
+        return false;
+    }
+
+    if (compressed)
+        tileData = decompress(tileData, size, method);
+
+    // Undo the filters in reverse order
+    for (int i = filters.size() - 1; i >= 0 && !tileData.isNull(); --i)
+        tileData = unfilter(tileData, filters.at(i), area.width(), size);
+
+    if (size != tileData.length()) {
+        mError = tr("Corrupt layer data for layer '%1'")
+                .arg(tileLayer->name());
+        return false;
+    }
+
     const unsigned char *data =
             reinterpret_cast<const unsigned char*>(tileData.constData());
-    int x = 0;
-    int y = 0;
+    int x = area.x();
+    int y = area.y();
 
     for (int i = 0; i < size - 3; i += 4) {
         const uint gid = data[i] |
@@ -489,45 +926,142 @@ void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
                          data[i + 2] << 16 |
                          data[i + 3] << 24;
 
-        tileLayer->setCell(x, y, cellForGid(gid));
+        Cell cell;
+        if (!cellForGid(gid, cell))
+            return false;
+
+        tileLayer->setCell(x, y, cell);
 
         x++;
-        if (x == tileLayer->width()) {
-            x = 0;
+        if (x == area.x() + area.width()) {
+            x = area.x();
             y++;
         }
     }
+
+    return true;
 }
 
-void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, const QString &text)
+bool LayerDataDecoder::decodeCSV(TileLayer *tileLayer, const QRect &area,
+                                 const QChar *begin, const QChar *end)
 {
-    QString trimText = text.trimmed();
-    QStringList tiles = trimText.split(QLatin1Char(','));
-
-    if (tiles.length() != tileLayer->width() * tileLayer->height()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
-        return;
+    // The numbers are parsed in place rather than splitting the text, which
+    // would allocate a string for each tile
+    const QChar comma(QLatin1Char(','));
+
+    while (begin != end && begin->isSpace())
+        ++begin;
+    while (end != begin && (end - 1)->isSpace())
+        --end;
+
+    int tileCount = 1;
+    for (const QChar *c = begin; c != end; ++c)
+        if (*c == comma)
+            ++tileCount;
+
+    if (tileCount != area.width() * area.height()) {
+        mError = tr("Corrupt layer data for layer '%1'")
+                .arg(tileLayer->name());
+        return false;
     }
 
-    for (int y = 0; y < tileLayer->height(); y++) {
-        for (int x = 0; x < tileLayer->width(); x++) {
+    const QChar *tileStart = begin;
+
+    for (int y = area.top(); y <= area.bottom(); y++) {
+        for (int x = area.left(); x <= area.right(); x++) {
+            const QChar *tileEnd = tileStart;
+            while (tileEnd != end && *tileEnd != comma)
+                ++tileEnd;
+
             bool conversionOk;
-            const uint gid = tiles.at(y * tileLayer->width() + x)
-                    .toUInt(&conversionOk);
+            const uint gid = uintValue(tileStart, tileEnd, &conversionOk);
             if (!conversionOk) {
-                xml.raiseError(
-                        tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                               .arg(x + 1).arg(y + 1).arg(tileLayer->name()));
-                return;
+                mError = tr("Unable to parse tile at (%1,%2) on layer '%3'")
+                        .arg(x + 1).arg(y + 1).arg(tileLayer->name());
+                return false;
             }
-            tileLayer->setCell(x, y, cellForGid(gid));
+
+            Cell cell;
+            if (!cellForGid(gid, cell))
+                return false;
+
+            tileLayer->setCell(x, y, cell);
+
+            tileStart = tileEnd + 1;
+        }
+    }
+
+    return true;
+}
+
+bool LayerDataDecoder::cellForGid(uint gid, Cell &cell)
+{
+    bool ok;
+    cell = mGidMapper.gidToCell(gid, ok);
+
+    if (!ok) {
+        if (mGidMapper.isEmpty())
+            mError = tr("Tile used but no tilesets specified");
+        else
+            mError = tr("Invalid tile: %1").arg(gid);
+    }
+
+    return ok;
+}
+
+void DeferredLayerData::addBinaryChunk(const QRect &area,
+                                       const QByteArray &latin1Text,
+                                       const QString &compression)
+{
+    Chunk chunk;
+    chunk.area = area;
+    chunk.latin1Text = latin1Text;
+    chunk.compression = compression;
+    chunk.csv = false;
+    mChunks.append(chunk);
+}
+
+void DeferredLayerData::addCSVChunk(const QRect &area, const QString &csvText)
+{
+    Chunk chunk;
+    chunk.area = area;
+    chunk.csvText = csvText;
+    chunk.csv = true;
+    mChunks.append(chunk);
+}
+
+bool DeferredLayerData::decode(TileLayer *tileLayer, QString *error)
+{
+    LayerDataDecoder decoder(mGidMapper);
+
+    foreach (const Chunk &chunk, mChunks) {
+        bool ok;
+
+        if (chunk.csv) {
+            const QString &text = chunk.csvText;
+            ok = decoder.decodeCSV(tileLayer, chunk.area,
+                                   text.unicode(),
+                                   text.unicode() + text.size());
+        } else {
+            ok = decoder.decodeBinary(tileLayer, chunk.area,
+                                      chunk.latin1Text, chunk.compression);
+        }
+
+        if (!ok) {
+            *error = decoder.errorString();
+            return false;
         }
     }
+
+    return true;
 }
 
 Cell MapReaderPrivate::cellForGid(uint gid)
 {
+    // Tiles can only be resolved once their tileset images are loaded
+    if (!mPendingImages.isEmpty())
+        finishTilesetImages();
+
     bool ok;
     const Cell result = mGidMapper.gidToCell(gid, ok);
 
@@ -547,10 +1081,10 @@ ObjectGroup *MapReaderPrivate::readObjectGroup()
 
     const QXmlStreamAttributes atts = xml.attributes();
     const QString name = atts.value(QLatin1String("name")).toString();
-    const int x = atts.value(QLatin1String("x")).toString().toInt();
-    const int y = atts.value(QLatin1String("y")).toString().toInt();
-    const int width = atts.value(QLatin1String("width")).toString().toInt();
-    const int height = atts.value(QLatin1String("height")).toString().toInt();
+    const int x = intValue(atts.value(QLatin1String("x")));
+    const int y = intValue(atts.value(QLatin1String("y")));
+    const int width = intValue(atts.value(QLatin1String("width")));
+    const int height = intValue(atts.value(QLatin1String("height")));
 
     ObjectGroup *objectGroup = new ObjectGroup(name, x, y, width, height);
     readLayerAttributes(objectGroup, atts);
@@ -593,11 +1127,11 @@ MapObject *MapReaderPrivate::readObject()
 
     const QXmlStreamAttributes atts = xml.attributes();
     const QString name = atts.value(QLatin1String("name")).toString();
-    const uint gid = atts.value(QLatin1String("gid")).toString().toUInt();
-    const int x = atts.value(QLatin1String("x")).toString().toInt();
-    const int y = atts.value(QLatin1String("y")).toString().toInt();
-    const int width = atts.value(QLatin1String("width")).toString().toInt();
-    const int height = atts.value(QLatin1String("height")).toString().toInt();
+    const uint gid = uintValue(atts.value(QLatin1String("gid")));
+    const int x = intValue(atts.value(QLatin1String("x")));
+    const int y = intValue(atts.value(QLatin1String("y")));
+    const int width = intValue(atts.value(QLatin1String("width")));
+    const int height = intValue(atts.value(QLatin1String("height")));
     const QString type = atts.value(QLatin1String("type")).toString();
 
     const QPointF pos = pixelToTileCoordinates(mMap, x, y);
@@ -637,28 +1171,44 @@ QPolygonF MapReaderPrivate::readPolygon()
                                       xml.name() == "polyline"));
 
     const QXmlStreamAttributes atts = xml.attributes();
-    const QString points = atts.value(QLatin1String("points")).toString();
-    const QStringList pointsList = points.split(QLatin1Char(' '),
-                                                QString::SkipEmptyParts);
+    const QStringRef points = atts.value(QLatin1String("points"));
+    const QChar space(QLatin1Char(' '));
+    const QChar comma(QLatin1Char(','));
+    const QChar *c = points.unicode();
+    const QChar *end = c + points.size();
 
     QPolygonF polygon;
     bool ok = true;
 
-    foreach (const QString &point, pointsList) {
-        const int commaPos = point.indexOf(QLatin1Char(','));
-        if (commaPos == -1) {
+    // Parse the space separated list of "x,y" pairs in place
+    while (c != end) {
+        if (*c == space) {
+            ++c;
+            continue;
+        }
+
+        const QChar *pointEnd = c;
+        while (pointEnd != end && *pointEnd != space)
+            ++pointEnd;
+
+        const QChar *commaPos = c;
+        while (commaPos != pointEnd && *commaPos != comma)
+            ++commaPos;
+
+        if (commaPos == pointEnd) {
             ok = false;
             break;
         }
 
-        const int x = point.left(commaPos).toInt(&ok);
+        const int x = intValue(c, commaPos, &ok);
         if (!ok)
             break;
-        const int y = point.mid(commaPos + 1).toInt(&ok);
+        const int y = intValue(commaPos + 1, pointEnd, &ok);
         if (!ok)
             break;
 
         polygon.append(pixelToTileCoordinates(mMap, x, y));
+        c = pointEnd;
     }
 
     if (!ok)
@@ -722,6 +1272,14 @@ Map *MapReader::readMap(QIODevice *device, const QString &path)
     return d->readMap(device, path);
 }
 
+Map *MapReader::readMapRegion(const QString &fileName, const QRect &region)
+{
+    d->mRegion = region;
+    Map *map = readMap(fileName);
+    d->mRegion = QRect();
+    return map;
+}
+
 Map *MapReader::readMap(const QString &fileName)
 {
     QFile file(fileName);
@@ -754,6 +1312,26 @@ QString MapReader::errorString() const
     return d->errorString();
 }
 
+void MapReader::setLayerDecodingDeferred(bool deferred)
+{
+    d->mLayerDecodingDeferred = deferred;
+}
+
+bool MapReader::isLayerDecodingDeferred() const
+{
+    return d->mLayerDecodingDeferred;
+}
+
+void MapReader::setTilesetCache(TilesetCache *cache)
+{
+    d->mTilesetCache = cache;
+}
+
+TilesetCache *MapReader::tilesetCache() const
+{
+    return d->mTilesetCache;
+}
+
 QString MapReader::resolveReference(const QString &reference,
                                     const QString &mapPath)
 {
@@ -771,6 +1349,9 @@ QImage MapReader::readExternalImage(const QString &source)
 Tileset *MapReader::readExternalTileset(const QString &source,
                                         QString *error)
 {
+    if (d->mTilesetCache)
+        return d->mTilesetCache->tileset(source, error);
+
     MapReader reader;
     Tileset *tileset = reader.readTileset(source);
     if (!tileset)
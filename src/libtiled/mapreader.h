@@ -32,6 +32,7 @@
 #include "tiled_global.h"
 
 #include <QImage>
+#include <QRect>
 
 class QFile;
 
@@ -39,6 +40,7 @@ namespace Tiled {
 
 class Map;
 class Tileset;
+class TilesetCache;
 
 namespace Internal {
 class MapReaderPrivate;
@@ -73,6 +75,17 @@ public:
      */
     Map *readMap(const QString &fileName);
 
+    /**
+     * Reads a TMX map from the given \a fileName, decoding only the layer
+     * data needed for the given \a region (in tiles). Layers stored in
+     * chunks only have the chunks intersecting the region decoded, and the
+     * cells outside of those chunks are left empty. Layers that are not
+     * stored in chunks are read completely.
+     *
+     * \sa MapWriter::setChunkSize()
+     */
+    Map *readMapRegion(const QString &fileName, const QRect &region);
+
     /**
      * Reads a TSX tileset from the given \a device. Optionally a \a path can
      * be given, which will be used to resolve relative references to external
@@ -95,6 +108,27 @@ public:
      */
     QString errorString() const;
 
+    /**
+     * Sets whether decoding of base64 and CSV encoded tile layer data is
+     * deferred until the cells of a layer are first accessed. This makes
+     * reading a map much faster when only some of its layers are needed.
+     *
+     * Errors in the layer data are then only detected once the layer is
+     * decoded, in which case a warning is printed. The tilesets of the map
+     * need to stay around until all its layers are decoded.
+     */
+    void setLayerDecodingDeferred(bool deferred);
+    bool isLayerDecodingDeferred() const;
+
+    /**
+     * Sets the \a cache used by readExternalTileset() to look up external
+     * tilesets, which can be shared between readers. The tilesets of maps
+     * read with a cache are owned by the cache. The reader does not take
+     * ownership of the cache.
+     */
+    void setTilesetCache(TilesetCache *cache);
+    TilesetCache *tilesetCache() const;
+
 protected:
     /**
      * Called for each \a reference to an external file. Should return the path
@@ -106,12 +140,16 @@ protected:
 
     /**
      * Called when an external image is encountered while a tileset is loaded.
+     *
+     * The images are decoded concurrently, so this function is called from a
+     * worker thread and needs to be thread-safe.
      */
     virtual QImage readExternalImage(const QString &source);
 
     /**
      * Called when an external tileset is encountered while a map is loaded.
-     * The default implementation just calls readTileset() on a new MapReader.
+     * The default implementation returns the tileset from the tileset cache
+     * when one is set, and otherwise calls readTileset() on a new MapReader.
      *
      * If an error occurred, the \a error parameter should be set to the error
      * message.
@@ -20,10 +20,97 @@
 
 #include "maprenderer.h"
 
+#include "map.h"
+#include "mapobject.h"
+#include "tile.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
 #include <QVector2D>
 
 using namespace Tiled;
 
+QRectF MapRenderer::boundingRect(const MapObject *object) const
+{
+    validateRenderCache(object);
+
+    MapObject::RenderCache &cache = object->mRenderCache;
+    if (!cache.hasBoundingRect) {
+        cache.boundingRect = objectBoundingRect(object);
+        cache.hasBoundingRect = true;
+    }
+    return cache.boundingRect;
+}
+
+QPainterPath MapRenderer::shape(const MapObject *object) const
+{
+    validateRenderCache(object);
+
+    MapObject::RenderCache &cache = object->mRenderCache;
+    if (!cache.hasShape) {
+        cache.shape = objectShape(object);
+        cache.hasShape = true;
+    }
+    return cache.shape;
+}
+
+const QPolygonF &MapRenderer::screenPolygon(const MapObject *object) const
+{
+    validateRenderCache(object);
+
+    MapObject::RenderCache &cache = object->mRenderCache;
+    if (!cache.hasScreenPolygon) {
+        const QPolygonF polygon =
+                object->polygon().translated(object->position());
+        cache.screenPolygon = tileToPixelCoords(polygon);
+        cache.hasScreenPolygon = true;
+    }
+    return cache.screenPolygon;
+}
+
+QImage MapRenderer::objectImage(const MapObject *object) const
+{
+    const Tile *tile = object->tile();
+    const qint64 imageKey = tile ? tile->image().cacheKey() : 0;
+
+    MapObject::RenderCache &cache = object->mRenderCache;
+    if (!cache.hasImage || cache.imageKey != imageKey) {
+        cache.image = object->toImage();
+        cache.imageKey = imageKey;
+        cache.hasImage = true;
+    }
+    return cache.image;
+}
+
+/**
+ * Drops the geometry cached with the given \a object when it was computed
+ * by another renderer, for a map of a different size or for a since
+ * replaced tile image. Changes to the object itself drop it right away.
+ */
+void MapRenderer::validateRenderCache(const MapObject *object) const
+{
+    const QSize tileSize(mMap->tileWidth(), mMap->tileHeight());
+    const QSize mapSize(mMap->width(), mMap->height());
+    const Tile *tile = object->tile();
+    const qint64 tileImageKey = tile ? tile->image().cacheKey() : 0;
+
+    MapObject::RenderCache &cache = object->mRenderCache;
+    if (cache.renderer == this
+            && cache.tileSize == tileSize
+            && cache.mapSize == mapSize
+            && cache.tileImageKey == tileImageKey) {
+        return;
+    }
+
+    cache.renderer = this;
+    cache.tileSize = tileSize;
+    cache.mapSize = mapSize;
+    cache.tileImageKey = tileImageKey;
+    cache.hasBoundingRect = false;
+    cache.hasShape = false;
+    cache.hasScreenPolygon = false;
+}
+
 /**
  * Converts a line running from \a start to \a end to a polygon which
  * extends 5 pixels from the line in all directions.
@@ -44,3 +131,87 @@ QPolygonF MapRenderer::lineToPolygon(const QPointF &start, const QPointF &end)
     polygon[3] = end + perpendicular + direction;
     return polygon;
 }
+
+
+CellRenderer::CellRenderer(QPainter *painter)
+    : mPainter(painter)
+{
+}
+
+void CellRenderer::render(const Cell &cell, const QPointF &pos)
+{
+    const Tile *tile = cell.tile;
+
+#if QT_VERSION >= 0x040700
+    // Tiles are drawn from the tileset image when possible, so that cells
+    // of different tiles from the same tileset end up in the same batch.
+    // Smooth scaling would blend in the pixels around the tile though.
+    const bool smooth =
+            (mPainter->renderHints() & QPainter::SmoothPixmapTransform)
+            && mPainter->worldTransform().type() > QTransform::TxTranslate;
+    const Tileset *tileset = tile->tileset();
+    const QRect tileRect = smooth ? QRect() : tileset->tileRect(tile->id());
+    const bool fromTileset = !tileRect.isEmpty();
+    const QPixmap &image = fromTileset ? tileset->image() : tile->image();
+    const QRectF source = fromTileset ? QRectF(tileRect)
+                                      : QRectF(tile->image().rect());
+
+    if (mImage.cacheKey() != image.cacheKey()) {
+        flush();
+        mImage = image;
+    }
+#else
+    const QPixmap &image = tile->image();
+    const QRectF source = image.rect();
+#endif
+
+    const bool rotated = cell.ang % 2;
+    const qreal width = rotated ? source.height() : source.width();
+    const qreal height = rotated ? source.width() : source.height();
+
+    // The flipping is applied before the rotation, like in Cell::toImage()
+    const qreal scaleX = cell.flippedHorizontally ? -1 : 1;
+    const qreal scaleY = cell.flippedVertically ? -1 : 1;
+    const qreal rotation = 90 * (cell.ang % 4);
+
+    // Transformations are done around the center of the tile
+    const QPointF center(pos.x() + width / 2, pos.y() - height / 2);
+
+#if QT_VERSION >= 0x040700
+    // Each fragment has its own flipping and rotation, so these don't need
+    // to break up the batch
+    const QPainter::PixmapFragment fragment =
+            QPainter::PixmapFragment::create(center, source,
+                                             scaleX, scaleY,
+                                             rotation);
+    mFragments.append(fragment);
+#else
+    if (scaleX == 1 && scaleY == 1 && rotation == 0) {
+        mPainter->drawPixmap(QPointF(pos.x(), pos.y() - height), image);
+        return;
+    }
+
+    const QTransform transform = mPainter->transform();
+    mPainter->translate(center);
+    mPainter->rotate(rotation);
+    mPainter->scale(scaleX, scaleY);
+    mPainter->drawPixmap(QPointF(-image.width() / 2.0,
+                                 -image.height() / 2.0), image);
+    mPainter->setTransform(transform);
+#endif
+}
+
+void CellRenderer::flush()
+{
+#if QT_VERSION >= 0x040700
+    if (mFragments.isEmpty())
+        return;
+
+    mPainter->drawPixmapFragments(mFragments.constData(),
+                                  mFragments.size(),
+                                  mImage);
+
+    mImage = QPixmap();
+    mFragments.resize(0);
+#endif
+}
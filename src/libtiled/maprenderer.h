@@ -32,12 +32,17 @@
 #include "tiled_global.h"
 
 #include <QPainter>
+#include <QVector>
+
+class QBitArray;
 
 namespace Tiled {
 
+class Cell;
 class Layer;
 class Map;
 class MapObject;
+class Tile;
 class TileLayer;
 
 /**
@@ -68,15 +73,19 @@ public:
     /**
      * Returns the bounding rectangle in pixels of the given \a object, as it
      * would be drawn by drawMapObject().
+     *
+     * The result is cached with the object until it changes.
      */
-    virtual QRectF boundingRect(const MapObject *object) const = 0;
+    QRectF boundingRect(const MapObject *object) const;
 
     /**
      * Returns the shape in pixels of the given \a object. This is used for
      * mouse interaction and should match the rendered object as closely as
      * possible.
+     *
+     * The result is cached with the object until it changes.
      */
-    virtual QPainterPath shape(const MapObject *object) const = 0;
+    QPainterPath shape(const MapObject *object) const;
 
     /**
      * Draws the tile grid in the specified \a rect using the given
@@ -88,10 +97,13 @@ public:
      * Draws the given \a layer using the given \a painter.
      *
      * Optionally, you can pass in the \a exposed rect (of pixels), so that
-     * only tiles that can be visible in this area will be drawn.
+     * only tiles that can be visible in this area will be drawn. Cells for
+     * which a bit is set in \a coveredCells are skipped, see
+     * OcclusionCuller.
      */
     virtual void drawTileLayer(QPainter *painter, const TileLayer *layer,
-                               const QRectF &exposed = QRectF()) const = 0;
+                               const QRectF &exposed = QRectF(),
+                               const QBitArray *coveredCells = 0) const = 0;
 
     /**
      * Draws the tile selection given by \a region in the specified \a color.
@@ -104,6 +116,20 @@ public:
                                    const QColor &color,
                                    const QRectF &exposed) const = 0;
 
+    /**
+     * Draws the given \a mask, in which each pixel covers a tile, with its
+     * top-left pixel on the tile at \a pos. This draws any number of tiles
+     * in a single call, which makes it suitable for drawing large or
+     * fragmented tile selections.
+     *
+     * The implementation can be optimized by taking into account the
+     * \a exposed rectangle, to avoid drawing too much.
+     */
+    virtual void drawTileMask(QPainter *painter,
+                              const QImage &mask,
+                              const QPoint &pos,
+                              const QRectF &exposed) const = 0;
+
     /**
      * Draws the \a object in the given \a color using the \a painter.
      */
@@ -152,10 +178,71 @@ protected:
      */
     const Map *map() const { return mMap; }
 
+    /**
+     * Computes the bounding rectangle of the given \a object.
+     * @see boundingRect()
+     */
+    virtual QRectF objectBoundingRect(const MapObject *object) const = 0;
+
+    /**
+     * Computes the shape of the given \a object.
+     * @see shape()
+     */
+    virtual QPainterPath objectShape(const MapObject *object) const = 0;
+
+    /**
+     * Returns the polygon of the given \a object in pixel coordinates,
+     * including the position of the object.
+     */
+    const QPolygonF &screenPolygon(const MapObject *object) const;
+
+    /**
+     * Returns the tile image of the given \a object, flipped and rotated as
+     * the object requires.
+     */
+    QImage objectImage(const MapObject *object) const;
+
 private:
+    void validateRenderCache(const MapObject *object) const;
+
     const Map *mMap;
 };
 
+/**
+ * Draws cells, taking their flipping and rotation into account. Subsequent
+ * cells with tiles from the same tileset image are drawn in a single call
+ * using QPainter::drawPixmapFragments, which avoids the overhead of drawing
+ * each tile separately. Tiles that are not part of their tileset image are
+ * drawn from their own image.
+ *
+ * The batch is drawn when a cell from a different image is rendered, when
+ * flush() is called or when the cell renderer is destroyed. The transform
+ * of the painter should not be changed in between.
+ */
+class TILEDSHARED_EXPORT CellRenderer
+{
+public:
+    CellRenderer(QPainter *painter);
+    ~CellRenderer() { flush(); }
+
+    /**
+     * Renders the given \a cell with its bottom-left corner at \a pos.
+     */
+    void render(const Cell &cell, const QPointF &pos);
+
+    /**
+     * Draws the cells that are still batched.
+     */
+    void flush();
+
+private:
+    QPainter * const mPainter;
+#if QT_VERSION >= 0x040700
+    QPixmap mImage;
+    QVector<QPainter::PixmapFragment> mFragments;
+#endif
+};
+
 } // namespace Tiled
 
 #endif // MAPRENDERER_H
@@ -41,7 +41,13 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QFuture>
+#include <QHash>
+#include <QStringList>
+#include <QTime>
 #include <QXmlStreamWriter>
+#include <QtConcurrentMap>
+#include <QtEndian>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -49,6 +55,34 @@ using namespace Tiled::Internal;
 namespace Tiled {
 namespace Internal {
 
+class MapWriterPrivate;
+
+/**
+ * The result of encoding a LayerDataBlock.
+ */
+struct EncodedLayerData
+{
+    QByteArray data;
+    int encodeTime;     // In milliseconds, -1 when the data was reused
+};
+
+/**
+ * A part of the tile layer data that is encoded on its own. This is either
+ * a whole layer or one of its chunks.
+ */
+struct LayerDataBlock
+{
+    LayerDataBlock() : encoded(false) {}
+
+    const MapWriterPrivate *writer;
+    const TileLayer *tileLayer;
+    QRect area;
+    bool encoded;       // Whether data holds the reused encoded data
+    QByteArray data;
+
+    EncodedLayerData encode() const;
+};
+
 class MapWriterPrivate
 {
     Q_DECLARE_TR_FUNCTIONS(MapReader)
@@ -62,17 +96,30 @@ public:
     void writeTileset(const Tileset *tileset, QIODevice *device,
                       const QString &path);
 
+    bool checkDecoding(const Map *map);
     bool openFile(QFile *file);
 
+    QByteArray encodeLayerData(const TileLayer *tileLayer,
+                               const QRect &area) const;
+
     QString mError;
     MapWriter::LayerDataFormat mLayerDataFormat;
+    int mCompressionLevel;
+    CompressionStrategy mCompressionStrategy;
+    QList<FilterMethod> mLayerDataFilters;
+    QSize mChunkSize;
     bool mDtdEnabled;
+    QList<MapWriter::LayerDataStatistics> mLayerDataStatistics;
 
 private:
     void writeMap(QXmlStreamWriter &w, const Map *map);
     void writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
                       uint firstGid);
+    void encodeLayerDataBlocks(const Map *map);
+    void updateLayerDataCache(const Map *map);
+    void updateLayerDataStatistics(const Map *map);
     void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer);
+    void writeLayerData(QXmlStreamWriter &w, const QByteArray &data);
     void writeLayerAttributes(QXmlStreamWriter &w, const Layer *layer);
     void writeObjectGroup(QXmlStreamWriter &w, const ObjectGroup *objectGroup);
     void writeObject(QXmlStreamWriter &w, const MapObject *mapObject);
@@ -82,6 +129,20 @@ private:
     QDir mMapDir;     // The directory in which the map is being saved
     GidMapper mGidMapper;
     bool mUseAbsolutePaths;
+
+    QList<LayerDataBlock> mLayerDataBlocks;
+    QFuture<EncodedLayerData> mEncodedLayerData;
+    int mNextLayerDataBlock;
+
+    // The encoded blocks of the previously written tile layers by their
+    // generation, along with the parameters that determined the encoding
+    QHash<uint, QList<LayerDataBlock> > mLayerDataCache;
+    MapWriter::LayerDataFormat mCachedLayerDataFormat;
+    int mCachedCompressionLevel;
+    CompressionStrategy mCachedCompressionStrategy;
+    QList<FilterMethod> mCachedLayerDataFilters;
+    QSize mCachedChunkSize;
+    QList<QPair<uint, const Tileset*> > mCachedTilesets;
 };
 
 } // namespace Internal
@@ -90,8 +151,15 @@ private:
 
 MapWriterPrivate::MapWriterPrivate()
     : mLayerDataFormat(MapWriter::Base64Gzip)
+    , mCompressionLevel(-1)
+    , mCompressionStrategy(DefaultStrategy)
+    , mChunkSize(0, 0)
     , mDtdEnabled(false)
     , mUseAbsolutePaths(false)
+    , mNextLayerDataBlock(0)
+    , mCachedLayerDataFormat(MapWriter::XML)
+    , mCachedCompressionLevel(-1)
+    , mCachedCompressionStrategy(DefaultStrategy)
 {
 }
 
@@ -113,9 +181,37 @@ static QXmlStreamWriter *createWriter(QIODevice *device)
     return writer;
 }
 
+/**
+ * Checks that all tile layers of the map were decoded successfully. A layer
+ * that failed to decode would be written with its cells missing, overwriting
+ * the original data. Sets the error and returns false otherwise.
+ */
+bool MapWriterPrivate::checkDecoding(const Map *map)
+{
+    foreach (const Layer *layer, map->layers()) {
+        const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer);
+        if (!tileLayer)
+            continue;
+
+        const QString error = tileLayer->decodingError();
+        if (!error.isEmpty()) {
+            mError = tr("Layer '%1' could not be loaded: %2")
+                    .arg(tileLayer->name(), error);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
                                 const QString &path)
 {
+    mError.clear();
+
+    if (!checkDecoding(map))
+        return;
+
     mMapDir = QDir(path);
     mUseAbsolutePaths = path.isEmpty();
 
@@ -192,6 +288,8 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
         firstGid += tileset->tileCount();
     }
 
+    encodeLayerDataBlocks(map);
+
     foreach (const Layer *layer, map->layers()) {
         if (dynamic_cast<const TileLayer*>(layer) != 0)
             writeTileLayer(w, static_cast<const TileLayer*>(layer));
@@ -199,6 +297,12 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
             writeObjectGroup(w, static_cast<const ObjectGroup*>(layer));
     }
 
+    updateLayerDataCache(map);
+    updateLayerDataStatistics(map);
+
+    mLayerDataBlocks.clear();
+    mEncodedLayerData = QFuture<EncodedLayerData>();
+
     w.writeEndElement();
 }
 
@@ -275,6 +379,255 @@ void MapWriterPrivate::writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
     w.writeEndElement();
 }
 
+/**
+ * Determines the compression method used by the given layer data \a format.
+ * Returns false when the format does not compress the layer data.
+ *
+ * Falls back to zlib when the method is not available in this build, so
+ * that a map is still saved in a readable way.
+ */
+static bool compressionMethod(MapWriter::LayerDataFormat format,
+                              CompressionMethod *method)
+{
+    switch (format) {
+    case MapWriter::Base64Gzip:
+        *method = Gzip;
+        break;
+    case MapWriter::Base64Zlib:
+        *method = Zlib;
+        break;
+    case MapWriter::Base64Zstandard:
+        *method = Zstandard;
+        break;
+    case MapWriter::Base64LZ4:
+        *method = LZ4;
+        break;
+    default:
+        return false;
+    }
+
+    if (!isCompressionMethodSupported(*method)) {
+        qWarning("Compression method not supported, using zlib instead");
+        *method = Zlib;
+    }
+
+    return true;
+}
+
+static QString compressionName(CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+        return QLatin1String("gzip");
+    case Zlib:
+        return QLatin1String("zlib");
+    case Zstandard:
+        return QLatin1String("zstd");
+    case LZ4:
+        return QLatin1String("lz4");
+    }
+
+    return QString();
+}
+
+static QString filterName(FilterMethod method)
+{
+    switch (method) {
+    case RowDelta:
+        return QLatin1String("delta");
+    case RunLength:
+        return QLatin1String("rle");
+    case ByteShuffle:
+        return QLatin1String("shuffle");
+    }
+
+    return QString();
+}
+
+static bool isEmptyArea(const TileLayer *tileLayer, const QRect &area)
+{
+    for (int y = area.top(); y <= area.bottom(); ++y)
+        for (int x = area.left(); x <= area.right(); ++x)
+            if (!tileLayer->cellAt(x, y).isEmpty())
+                return false;
+
+    return true;
+}
+
+EncodedLayerData LayerDataBlock::encode() const
+{
+    EncodedLayerData result;
+
+    if (encoded) {
+        result.data = data;
+        result.encodeTime = -1;
+        return result;
+    }
+
+    QTime timer;
+    timer.start();
+    result.data = writer->encodeLayerData(tileLayer, area);
+    result.encodeTime = timer.elapsed();
+    return result;
+}
+
+/**
+ * Starts encoding the data of all tile layers of the \a map on the thread
+ * pool, since encoding and compressing it is the expensive part of saving
+ * a map. The results are written in order by writeTileLayer().
+ */
+void MapWriterPrivate::encodeLayerDataBlocks(const Map *map)
+{
+    mLayerDataBlocks.clear();
+    mNextLayerDataBlock = 0;
+
+    if (mLayerDataFormat == MapWriter::XML)
+        return;
+
+    // The cached data can only be reused when it would be encoded the same
+    QList<QPair<uint, const Tileset*> > tilesets;
+    uint firstGid = 1;
+    foreach (const Tileset *tileset, map->tilesets()) {
+        tilesets.append(qMakePair(firstGid, tileset));
+        firstGid += tileset->tileCount();
+    }
+
+    if (mCachedLayerDataFormat != mLayerDataFormat
+            || mCachedCompressionLevel != mCompressionLevel
+            || mCachedCompressionStrategy != mCompressionStrategy
+            || mCachedLayerDataFilters != mLayerDataFilters
+            || mCachedChunkSize != mChunkSize
+            || mCachedTilesets != tilesets) {
+        mLayerDataCache.clear();
+        mCachedLayerDataFormat = mLayerDataFormat;
+        mCachedCompressionLevel = mCompressionLevel;
+        mCachedCompressionStrategy = mCompressionStrategy;
+        mCachedLayerDataFilters = mLayerDataFilters;
+        mCachedChunkSize = mChunkSize;
+        mCachedTilesets = tilesets;
+    }
+
+    foreach (const Layer *layer, map->layers()) {
+        const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer);
+        if (!tileLayer)
+            continue;
+
+        // Reuse the data written previously when the layer didn't change
+        QHash<uint, QList<LayerDataBlock> >::const_iterator cached =
+                mLayerDataCache.find(tileLayer->generation());
+        if (cached != mLayerDataCache.end()) {
+            foreach (LayerDataBlock block, cached.value()) {
+                block.tileLayer = tileLayer;
+                mLayerDataBlocks.append(block);
+            }
+            continue;
+        }
+
+        // Decoding modifies the layer, so it can't be left to the workers
+        tileLayer->ensureDecoded();
+
+        LayerDataBlock block;
+        block.writer = this;
+        block.tileLayer = tileLayer;
+
+        const QRect layerArea(0, 0, tileLayer->width(), tileLayer->height());
+
+        if (mChunkSize.isEmpty()) {
+            block.area = layerArea;
+            mLayerDataBlocks.append(block);
+            continue;
+        }
+
+        const int chunkWidth = mChunkSize.width();
+        const int chunkHeight = mChunkSize.height();
+
+        for (int y = 0; y < tileLayer->height(); y += chunkHeight) {
+            for (int x = 0; x < tileLayer->width(); x += chunkWidth) {
+                block.area = QRect(x, y, chunkWidth, chunkHeight)
+                        .intersected(layerArea);
+
+                // Empty chunks can be left out, the reader leaves the
+                // cells they would cover empty
+                if (!isEmptyArea(tileLayer, block.area))
+                    mLayerDataBlocks.append(block);
+            }
+        }
+    }
+
+    mEncodedLayerData = QtConcurrent::mapped(mLayerDataBlocks,
+                                             &LayerDataBlock::encode);
+}
+
+/**
+ * Remembers the encoded data of the tile layers of the \a map, so that it
+ * can be reused by the next writeMap() call for the layers that don't
+ * change in the meantime. Data of layers no longer in the map is dropped.
+ */
+void MapWriterPrivate::updateLayerDataCache(const Map *map)
+{
+    mLayerDataCache.clear();
+
+    if (mLayerDataFormat == MapWriter::XML)
+        return;
+
+    // Layers without any blocks need an entry as well
+    foreach (const Layer *layer, map->layers())
+        if (const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer))
+            mLayerDataCache[tileLayer->generation()];
+
+    for (int i = 0; i < mLayerDataBlocks.size(); ++i) {
+        LayerDataBlock block = mLayerDataBlocks.at(i);
+        block.encoded = true;
+        block.data = mEncodedLayerData.resultAt(i).data;
+        mLayerDataCache[block.tileLayer->generation()].append(block);
+    }
+}
+
+/**
+ * Sums up the sizes and encoding times of the blocks of each tile layer.
+ */
+void MapWriterPrivate::updateLayerDataStatistics(const Map *map)
+{
+    mLayerDataStatistics.clear();
+
+    if (mLayerDataFormat == MapWriter::XML)
+        return;
+
+    int blockIndex = 0;
+
+    foreach (const Layer *layer, map->layers()) {
+        const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer);
+        if (!tileLayer)
+            continue;
+
+        MapWriter::LayerDataStatistics statistics;
+        statistics.layerName = tileLayer->name();
+        statistics.uncompressedSize = 0;
+        statistics.encodedSize = 0;
+        statistics.encodeTime = 0;
+        statistics.reused = false;
+
+        for (; blockIndex < mLayerDataBlocks.size(); ++blockIndex) {
+            const LayerDataBlock &block = mLayerDataBlocks.at(blockIndex);
+            if (block.tileLayer != tileLayer)
+                break;
+
+            const EncodedLayerData result =
+                    mEncodedLayerData.resultAt(blockIndex);
+
+            statistics.uncompressedSize +=
+                    block.area.width() * block.area.height() * 4;
+            statistics.encodedSize += result.data.size();
+            if (result.encodeTime == -1)
+                statistics.reused = true;
+            else
+                statistics.encodeTime += result.encodeTime;
+        }
+
+        mLayerDataStatistics.append(statistics);
+    }
+}
+
 void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
                                       const TileLayer *tileLayer)
 {
@@ -285,19 +638,22 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
     QString encoding;
     QString compression;
 
-    if (mLayerDataFormat == MapWriter::Base64
-            || mLayerDataFormat == MapWriter::Base64Gzip
-            || mLayerDataFormat == MapWriter::Base64Zlib) {
-
+    if (mLayerDataFormat == MapWriter::CSV) {
+        encoding = QLatin1String("csv");
+    } else if (mLayerDataFormat != MapWriter::XML) {
         encoding = QLatin1String("base64");
 
-        if (mLayerDataFormat == MapWriter::Base64Gzip)
-            compression = QLatin1String("gzip");
-        else if (mLayerDataFormat == MapWriter::Base64Zlib)
-            compression = QLatin1String("zlib");
+        // The filters are listed in front of the compression method
+        QStringList parts;
+        foreach (FilterMethod filter, mLayerDataFilters)
+            parts.append(filterName(filter));
 
-    } else if (mLayerDataFormat == MapWriter::CSV)
-        encoding = QLatin1String("csv");
+        CompressionMethod method;
+        if (compressionMethod(mLayerDataFormat, &method))
+            parts.append(compressionName(method));
+
+        compression = parts.join(QLatin1String("+"));
+    }
 
     w.writeStartElement(QLatin1String("data"));
     if (!encoding.isEmpty())
@@ -314,48 +670,143 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
                 w.writeEndElement();
             }
         }
-    } else if (mLayerDataFormat == MapWriter::CSV) {
-        QString tileData;
-
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append(QString::number(gid));
-                if (x != tileLayer->width() - 1
-                    || y != tileLayer->height() - 1)
-                    tileData.append(QLatin1String(","));
+    } else {
+        // Write the blocks of this layer, waiting for their encoding to
+        // finish where necessary
+        while (mNextLayerDataBlock < mLayerDataBlocks.size()) {
+            const LayerDataBlock &block =
+                    mLayerDataBlocks.at(mNextLayerDataBlock);
+            if (block.tileLayer != tileLayer)
+                break;
+
+            const QByteArray data =
+                    mEncodedLayerData.resultAt(mNextLayerDataBlock).data;
+            ++mNextLayerDataBlock;
+
+            if (mChunkSize.isEmpty()) {
+                writeLayerData(w, data);
+                continue;
             }
-            tileData.append(QLatin1String("\n"));
+
+            const QRect &area = block.area;
+            w.writeStartElement(QLatin1String("chunk"));
+            w.writeAttribute(QLatin1String("x"), QString::number(area.x()));
+            w.writeAttribute(QLatin1String("y"), QString::number(area.y()));
+            w.writeAttribute(QLatin1String("width"),
+                             QString::number(area.width()));
+            w.writeAttribute(QLatin1String("height"),
+                             QString::number(area.height()));
+            writeLayerData(w, data);
+            w.writeEndElement(); // </chunk>
         }
+    }
 
-        w.writeCharacters(QLatin1String("\n"));
-        w.writeCharacters(tileData);
-    } else {
-        QByteArray tileData;
-        tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
+    w.writeEndElement(); // </data>
+    w.writeEndElement(); // </layer>
+}
 
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
+/**
+ * Writes the decimal representation of \a value to \a out and returns a
+ * pointer just past the last written digit.
+ */
+static char *formatNumber(uint value, char *out)
+{
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    while (count)
+        *out++ = digits[--count];
+
+    return out;
+}
+
+/**
+ * Encodes the cells in the given \a area of the tile layer, using the
+ * current layer data format. For CSV this returns the text, for base64 it
+ * returns the (compressed) data that still needs to be base64 encoded.
+ *
+ * This function is called from worker threads.
+ */
+QByteArray MapWriterPrivate::encodeLayerData(const TileLayer *tileLayer,
+                                             const QRect &area) const
+{
+    QByteArray tileData;
+
+    if (mLayerDataFormat == MapWriter::CSV) {
+        // Up to 10 digits and a comma for each cell, and a newline per row
+        tileData.resize(area.width() * area.height() * 11 + area.height());
+        char *out = tileData.data();
+
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            for (int x = area.left(); x <= area.right(); ++x) {
                 const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append((char) (gid));
-                tileData.append((char) (gid >> 8));
-                tileData.append((char) (gid >> 16));
-                tileData.append((char) (gid >> 24));
+                out = formatNumber(gid, out);
+                if (x != area.right() || y != area.bottom())
+                    *out++ = ',';
             }
+            *out++ = '\n';
+        }
+
+        tileData.resize(int(out - tileData.constData()));
+        return tileData;
+    }
+
+    tileData.resize(area.height() * area.width() * 4);
+    uchar *out = reinterpret_cast<uchar*>(tileData.data());
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+            const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
+            qToLittleEndian<quint32>(gid, out);
+            out += 4;
         }
+    }
+
+    foreach (FilterMethod method, mLayerDataFilters)
+        tileData = filter(tileData, method, area.width());
 
-        if (mLayerDataFormat == MapWriter::Base64Gzip)
-            tileData = compress(tileData, Gzip);
-        else if (mLayerDataFormat == MapWriter::Base64Zlib)
-            tileData = compress(tileData, Zlib);
+    CompressionMethod method;
+    if (compressionMethod(mLayerDataFormat, &method))
+        tileData = compress(tileData, method, mCompressionLevel,
+                            mCompressionStrategy);
 
+    return tileData;
+}
+
+/**
+ * Writes layer data encoded by encodeLayerData().
+ *
+ * The data only consists of ASCII characters that need no escaping, so it
+ * is written straight to the device rather than through the XML writer.
+ * The base64 encoding is done in pieces to avoid holding all of it in
+ * memory.
+ */
+void MapWriterPrivate::writeLayerData(QXmlStreamWriter &w,
+                                      const QByteArray &data)
+{
+    QIODevice *device = w.device();
+
+    if (mLayerDataFormat == MapWriter::CSV) {
+        // Also finishes the start tag of the parent element
+        w.writeCharacters(QLatin1String("\n"));
+        device->write(data);
+    } else {
         w.writeCharacters(QLatin1String("\n   "));
-        w.writeCharacters(QString::fromLatin1(tileData.toBase64()));
+
+        // A multiple of 3, so that no padding is added between the pieces
+        const int pieceSize = 3 * 16 * 1024;
+        for (int i = 0; i < data.size(); i += pieceSize) {
+            const int size = qMin(pieceSize, data.size() - i);
+            device->write(QByteArray::fromRawData(data.constData() + i,
+                                                  size).toBase64());
+        }
+
         w.writeCharacters(QLatin1String("\n  "));
     }
-
-    w.writeEndElement(); // </data>
-    w.writeEndElement(); // </layer>
 }
 
 void MapWriterPrivate::writeLayerAttributes(QXmlStreamWriter &w,
@@ -524,12 +975,20 @@ void MapWriter::writeMap(const Map *map, QIODevice *device,
 
 bool MapWriter::writeMap(const Map *map, const QString &fileName)
 {
+    // Check before opening the file, which would truncate it
+    d->mError.clear();
+    if (!d->checkDecoding(map))
+        return false;
+
     QFile file(fileName);
     if (!d->openFile(&file))
         return false;
 
     writeMap(map, &file, QFileInfo(fileName).absolutePath());
 
+    if (!d->mError.isEmpty())
+        return false;
+
     if (file.error() != QFile::NoError) {
         d->mError = file.errorString();
         return false;
@@ -575,6 +1034,51 @@ MapWriter::LayerDataFormat MapWriter::layerDataFormat() const
     return d->mLayerDataFormat;
 }
 
+void MapWriter::setCompressionLevel(int level)
+{
+    d->mCompressionLevel = level;
+}
+
+int MapWriter::compressionLevel() const
+{
+    return d->mCompressionLevel;
+}
+
+void MapWriter::setCompressionStrategy(CompressionStrategy strategy)
+{
+    d->mCompressionStrategy = strategy;
+}
+
+CompressionStrategy MapWriter::compressionStrategy() const
+{
+    return d->mCompressionStrategy;
+}
+
+QList<MapWriter::LayerDataStatistics> MapWriter::layerDataStatistics() const
+{
+    return d->mLayerDataStatistics;
+}
+
+void MapWriter::setLayerDataFilters(const QList<FilterMethod> &filters)
+{
+    d->mLayerDataFilters = filters;
+}
+
+QList<FilterMethod> MapWriter::layerDataFilters() const
+{
+    return d->mLayerDataFilters;
+}
+
+void MapWriter::setChunkSize(const QSize &size)
+{
+    d->mChunkSize = size;
+}
+
+QSize MapWriter::chunkSize() const
+{
+    return d->mChunkSize;
+}
+
 void MapWriter::setDtdEnabled(bool enabled)
 {
     d->mDtdEnabled = enabled;
@@ -30,8 +30,11 @@
 #ifndef MAPWRITER_H
 #define MAPWRITER_H
 
+#include "compression.h"
 #include "tiled_global.h"
 
+#include <QList>
+#include <QSize>
 #include <QString>
 
 class QIODevice;
@@ -59,8 +62,14 @@ public:
      * be given, which will be used to create relative references to external
      * images and tilesets.
      *
+     * The encoded tile layer data is kept until the next call, which reuses
+     * it for the tile layers that did not change in the meantime (see
+     * TileLayer::generation()). Keep using the same writer to benefit from
+     * this when saving a map repeatedly.
+     *
      * Error checking will need to be done on the \a device after calling this
-     * function.
+     * function. Nothing is written and errorString() is set when one of the
+     * tile layers failed to decode (see TileLayer::decodingError()).
      */
     void writeMap(const Map *map, QIODevice *device,
                   const QString &path = QString());
@@ -79,7 +88,8 @@ public:
      * images.
      *
      * Error checking will need to be done on the \a device after calling this
-     * function.
+     * function. Nothing is written and errorString() is set when one of the
+     * tile layers failed to decode (see TileLayer::decodingError()).
      */
     void writeTileset(const Tileset *tileset, QIODevice *device,
                       const QString &path = QString());
@@ -101,11 +111,13 @@ public:
      * The different formats in which the tile layer data can be stored.
      */
     enum LayerDataFormat {
-        XML        = 0,
-        Base64     = 1,
-        Base64Gzip = 2,
-        Base64Zlib = 3,
-        CSV        = 4
+        XML             = 0,
+        Base64          = 1,
+        Base64Gzip      = 2,
+        Base64Zlib      = 3,
+        CSV             = 4,
+        Base64Zstandard = 5,
+        Base64LZ4       = 6
     };
 
     /**
@@ -114,6 +126,65 @@ public:
     void setLayerDataFormat(LayerDataFormat format);
     LayerDataFormat layerDataFormat() const;
 
+    /**
+     * Sets the level used when compressing the tile layer data. The meaning
+     * of the level depends on the compression method (see Tiled::compress).
+     * The default of -1 uses the default level of the compression method.
+     */
+    void setCompressionLevel(int level);
+    int compressionLevel() const;
+
+    /**
+     * Sets the strategy used when compressing the tile layer data with gzip
+     * or zlib. The RunLengthStrategy is often faster while compressing tile
+     * layer data nearly as well.
+     */
+    void setCompressionStrategy(CompressionStrategy strategy);
+    CompressionStrategy compressionStrategy() const;
+
+    /**
+     * Sets the filters that are applied, in the given order, to the tile
+     * layer data before it is compressed. Filters often make the data
+     * compress better. They are only used with the base64 layer data
+     * formats, and are listed in the compression attribute (for example
+     * "delta+shuffle+zlib").
+     */
+    void setLayerDataFilters(const QList<FilterMethod> &filters);
+    QList<FilterMethod> layerDataFilters() const;
+
+    /**
+     * Sets the size (in tiles) of the chunks in which the tile layer data is
+     * stored. Each chunk is encoded and compressed independently, which
+     * allows reading parts of a layer without decoding all of it. Chunks
+     * without any tiles are left out.
+     *
+     * An empty size, which is the default, stores each layer as a single
+     * block. Chunks are not used with the XML layer data format.
+     *
+     * \sa MapReader::readMapRegion()
+     */
+    void setChunkSize(const QSize &size);
+    QSize chunkSize() const;
+
+    /**
+     * Statistics about the encoding of the data of a tile layer.
+     */
+    struct LayerDataStatistics
+    {
+        QString layerName;
+        int uncompressedSize;   ///< Size of the global tile IDs in bytes
+        int encodedSize;        ///< Size of the data before base64 encoding
+        int encodeTime;         ///< Time spent encoding in milliseconds
+        bool reused;            ///< Whether previously encoded data was used
+    };
+
+    /**
+     * Returns statistics about the encoding of each tile layer of the map
+     * that was written last. These can help to choose the layer data format
+     * and compression settings. Empty for the XML layer data format.
+     */
+    QList<LayerDataStatistics> layerDataStatistics() const;
+
     /**
      * Sets whether the DTD reference is written when saving the map.
      */
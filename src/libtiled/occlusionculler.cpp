@@ -0,0 +1,199 @@
+/*
+ * occlusionculler.cpp
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "occlusionculler.h"
+
+#include "map.h"
+#include "tile.h"
+#include "tilelayer.h"
+
+#include <QImage>
+#include <QVector>
+
+using namespace Tiled;
+
+OcclusionCuller::OcclusionCuller()
+    : mMap(0)
+{
+}
+
+void OcclusionCuller::setMap(const Map *map)
+{
+    mMap = map;
+    clearTileCache();
+    update();
+}
+
+void OcclusionCuller::update()
+{
+    mCoveredCells.clear();
+
+    if (!mMap || mMap->orientation() != Map::Orthogonal)
+        return;
+
+    foreach (const Layer *layer, mMap->layers()) {
+        if (const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer))
+            mCoveredCells.insert(tileLayer,
+                                 QBitArray(tileLayer->width() *
+                                           tileLayer->height()));
+    }
+
+    update(QRegion(0, 0, mMap->width(), mMap->height()));
+}
+
+void OcclusionCuller::update(const QRegion &region)
+{
+    if (mCoveredCells.isEmpty())
+        return;
+
+    // The tile layers from the top down, with their covered cells
+    QVector<const TileLayer*> tileLayers;
+    QVector<QBitArray*> coveredCells;
+
+    const QList<Layer*> &layers = mMap->layers();
+    for (int i = layers.size() - 1; i >= 0; --i) {
+        const TileLayer *tileLayer =
+                dynamic_cast<const TileLayer*>(layers.at(i));
+        if (tileLayer) {
+            tileLayers.append(tileLayer);
+            coveredCells.append(&mCoveredCells[tileLayer]);
+        }
+    }
+
+    const QRegion mapRegion = region & QRect(0, 0, mMap->width(),
+                                             mMap->height());
+
+    foreach (const QRect &rect, mapRegion.rects()) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                bool covered = false;
+
+                for (int i = 0; i < tileLayers.size(); ++i) {
+                    const TileLayer *tileLayer = tileLayers.at(i);
+                    const int localX = x - tileLayer->x();
+                    const int localY = y - tileLayer->y();
+                    if (!tileLayer->contains(localX, localY))
+                        continue;
+
+                    const Cell &cell = tileLayer->cellAt(localX, localY);
+                    const int index = localX + localY * tileLayer->width();
+                    coveredCells.at(i)->setBit(index,
+                                               covered && fitsInCell(cell));
+
+                    if (!covered && tileLayer->isVisible()
+                            && tileLayer->opacity() == 1
+                            && coversCell(cell)) {
+                        covered = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void OcclusionCuller::clearTileCache()
+{
+    mOpaqueTiles.clear();
+}
+
+const QBitArray *OcclusionCuller::coveredCells(const TileLayer *layer) const
+{
+    QHash<const TileLayer*, QBitArray>::const_iterator it =
+            mCoveredCells.find(layer);
+    if (it == mCoveredCells.end())
+        return 0;
+
+    return &it.value();
+}
+
+/**
+ * Returns whether the given \a cell completely hides what is below it.
+ */
+bool OcclusionCuller::coversCell(const Cell &cell) const
+{
+    if (cell.isEmpty())
+        return false;
+
+    const Tile *tile = cell.tile;
+    const bool rotated = cell.ang % 2;
+    const int width = rotated ? tile->height() : tile->width();
+    const int height = rotated ? tile->width() : tile->height();
+
+    return width == mMap->tileWidth() && height == mMap->tileHeight()
+            && isOpaque(tile);
+}
+
+/**
+ * Returns whether the given \a cell is drawn entirely within its own cell,
+ * so that it can be skipped when that cell is covered.
+ */
+bool OcclusionCuller::fitsInCell(const Cell &cell) const
+{
+    if (cell.isEmpty())
+        return false;
+
+    const Tile *tile = cell.tile;
+    const bool rotated = cell.ang % 2;
+    const int width = rotated ? tile->height() : tile->width();
+    const int height = rotated ? tile->width() : tile->height();
+
+    return width <= mMap->tileWidth() && height <= mMap->tileHeight();
+}
+
+/**
+ * Returns whether the image of the given \a tile has no transparent pixels.
+ * The result is cached, since this requires looking at all its pixels.
+ */
+bool OcclusionCuller::isOpaque(const Tile *tile) const
+{
+    QHash<const Tile*, bool>::const_iterator it = mOpaqueTiles.find(tile);
+    if (it != mOpaqueTiles.end())
+        return it.value();
+
+    bool opaque = true;
+    const QPixmap &pixmap = tile->image();
+
+    if (pixmap.isNull()) {
+        opaque = false;
+    } else if (pixmap.hasAlpha()) {
+        const QImage image =
+                pixmap.toImage().convertToFormat(QImage::Format_ARGB32);
+
+        for (int y = 0; opaque && y < image.height(); ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.scanLine(y));
+            for (int x = 0; x < image.width(); ++x) {
+                if (qAlpha(line[x]) != 255) {
+                    opaque = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    mOpaqueTiles.insert(tile, opaque);
+    return opaque;
+}
@@ -0,0 +1,108 @@
+/*
+ * occlusionculler.h
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "tiled_global.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QRegion>
+
+namespace Tiled {
+
+class Cell;
+class Map;
+class Tile;
+class TileLayer;
+
+/**
+ * Determines which cells of the tile layers of a map are hidden behind
+ * opaque tiles on the visible layers above them. The renderers skip these
+ * cells when they are passed to MapRenderer::drawTileLayer.
+ *
+ * A cell only hides the cells below it when its layer is fully opaque and
+ * its tile is opaque and exactly the size of a map tile. The hidden cells
+ * need to have tiles that fit in a map tile. Since only such tiles are
+ * known to cover exactly one cell, culling is limited to orthogonal maps.
+ */
+class TILEDSHARED_EXPORT OcclusionCuller
+{
+public:
+    OcclusionCuller();
+
+    /**
+     * Sets the map for which to determine the covered cells, and determines
+     * them for the whole map.
+     */
+    void setMap(const Map *map);
+
+    /**
+     * Determines the covered cells for the whole map. Should be called when
+     * layers were added, removed or changed their visibility or opacity.
+     */
+    void update();
+
+    /**
+     * Determines the covered cells within the given \a region, in tile
+     * coordinates. Should be called when the cells in this region changed.
+     */
+    void update(const QRegion &region);
+
+    /**
+     * Forgets which tiles are opaque. Should be called when tile images
+     * have changed, followed by a call to update().
+     */
+    void clearTileCache();
+
+    /**
+     * Returns whether any cells can be covered on the current map. When this
+     * is false, coveredCells() always returns 0.
+     */
+    bool isActive() const { return !mCoveredCells.isEmpty(); }
+
+    /**
+     * Returns a bit for each cell of the given \a layer, at index
+     * x + y * width, which is set when the cell is covered. Returns 0 when
+     * the layer is not known.
+     */
+    const QBitArray *coveredCells(const TileLayer *layer) const;
+
+private:
+    bool coversCell(const Cell &cell) const;
+    bool fitsInCell(const Cell &cell) const;
+    bool isOpaque(const Tile *tile) const;
+
+    const Map *mMap;
+    QHash<const TileLayer*, QBitArray> mCoveredCells;
+    mutable QHash<const Tile*, bool> mOpaqueTiles;
+};
+
+} // namespace Tiled
+
+#endif // OCCLUSIONCULLER_H
@@ -33,6 +33,8 @@
 #include "tile.h"
 #include "tilelayer.h"
 
+#include <QBitArray>
+
 #include <cmath>
 
 using namespace Tiled;
@@ -54,7 +56,7 @@ QRect OrthogonalRenderer::boundingRect(const QRect &rect) const
                  rect.height() * tileHeight);
 }
 
-QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
+QRectF OrthogonalRenderer::objectBoundingRect(const MapObject *object) const
 {
     const QRectF bounds = object->bounds();
     const QRectF rect(tileToPixelCoords(bounds.topLeft()),
@@ -64,7 +66,7 @@ QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
 
     if (object->tile()) {
         const QPointF bottomLeft = rect.topLeft();
-        const QImage img = object->toImage();
+        const QImage img = objectImage(object);
         boundingRect = QRectF(bottomLeft.x(),
                               bottomLeft.y() - img.height(),
                               img.width(),
@@ -83,10 +85,8 @@ QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
 
         case MapObject::Polygon:
         case MapObject::Polyline: {
-            const QPointF &pos = object->position();
-            const QPolygonF polygon = object->polygon().translated(pos);
-            QPolygonF screenPolygon = tileToPixelCoords(polygon);
-            boundingRect = screenPolygon.boundingRect().adjusted(-2, -2, 3, 3);
+            const QRectF polygonRect = screenPolygon(object).boundingRect();
+            boundingRect = polygonRect.adjusted(-2, -2, 3, 3);
             break;
         }
         }
@@ -95,7 +95,7 @@ QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
     return boundingRect;
 }
 
-QPainterPath OrthogonalRenderer::shape(const MapObject *object) const
+QPainterPath OrthogonalRenderer::objectShape(const MapObject *object) const
 {
     QPainterPath path;
 
@@ -117,9 +117,7 @@ QPainterPath OrthogonalRenderer::shape(const MapObject *object) const
         }
         case MapObject::Polygon:
         case MapObject::Polyline: {
-            const QPointF &pos = object->position();
-            const QPolygonF polygon = object->polygon().translated(pos);
-            const QPolygonF screenPolygon = tileToPixelCoords(polygon);
+            const QPolygonF &screenPolygon = this->screenPolygon(object);
             if (object->shape() == MapObject::Polygon) {
                 path.addPolygon(screenPolygon);
             } else {
@@ -152,30 +150,106 @@ void OrthogonalRenderer::drawGrid(QPainter *painter, const QRectF &rect) const
     const int endY = qMin((int) std::ceil(rect.bottom()),
                           map()->height() * tileHeight + 1);
 
+    if (startX >= endX || startY >= endY)
+        return;
+
+    // When the tiles are a whole number of device pixels in size, the grid
+    // is filled in with a pre-rendered pattern, which is a lot faster than
+    // drawing each of the dashed lines
+    const QTransform transform = painter->deviceTransform();
+    const qreal scale = transform.m11();
+    const qreal deviceTileWidth = tileWidth * scale;
+    const qreal deviceTileHeight = tileHeight * scale;
+
+    if (transform.type() <= QTransform::TxScale
+            && scale == transform.m22()
+            && deviceTileWidth >= 1 && deviceTileHeight >= 1
+            && qAbs(deviceTileWidth - qRound(deviceTileWidth)) < 0.01
+            && qAbs(deviceTileHeight - qRound(deviceTileHeight)) < 0.01) {
+        const QPixmap &pattern = gridPattern(qRound(deviceTileWidth),
+                                             qRound(deviceTileHeight));
+        const QPoint origin(qRound(transform.dx()), qRound(transform.dy()));
+        const QRect area(origin + QPoint(qRound(startX * scale),
+                                         qRound(startY * scale)),
+                         origin + QPoint(qRound((endX - 1) * scale),
+                                         qRound((endY - 1) * scale)));
+
+        painter->save();
+        painter->resetTransform();
+        painter->setBrushOrigin(origin);
+        painter->fillRect(area, QBrush(pattern));
+        painter->restore();
+        return;
+    }
+
     QColor gridColor(Qt::black);
     gridColor.setAlpha(128);
 
     QPen gridPen(gridColor);
     gridPen.setDashPattern(QVector<qreal>() << 2 << 2);
 
-    if (startY < endY) {
-        gridPen.setDashOffset(startY);
-        painter->setPen(gridPen);
-        for (int x = startX; x < endX; x += tileWidth)
-            painter->drawLine(x, startY, x, endY - 1);
-    }
+    gridPen.setDashOffset(startY);
+    painter->setPen(gridPen);
+    for (int x = startX; x < endX; x += tileWidth)
+        painter->drawLine(x, startY, x, endY - 1);
+
+    gridPen.setDashOffset(startX);
+    painter->setPen(gridPen);
+    for (int y = startY; y < endY; y += tileHeight)
+        painter->drawLine(startX, y, endX - 1, y);
+}
 
-    if (startX < endX) {
-        gridPen.setDashOffset(startX);
-        painter->setPen(gridPen);
-        for (int y = startY; y < endY; y += tileHeight)
-            painter->drawLine(startX, y, endX - 1, y);
+/**
+ * Returns a pattern of the grid for tiles of the given size in device
+ * pixels. It covers enough tiles for the dashes to continue seamlessly when
+ * it is repeated. The last pattern is kept, since the size only changes
+ * when zooming.
+ */
+const QPixmap &OrthogonalRenderer::gridPattern(int tileWidth,
+                                               int tileHeight) const
+{
+    const QSize tileSize(tileWidth, tileHeight);
+    if (mGridPatternTileSize == tileSize)
+        return mGridPattern;
+
+    // The dashes are 2 pixels long with gaps of 2 pixels, so the size needs
+    // to be a multiple of 4. Small patterns are made larger, since they are
+    // slower to fill with.
+    int tilesAcross = 1;
+    while ((tileWidth * tilesAcross) % 4 || tileWidth * tilesAcross < 64)
+        tilesAcross *= 2;
+    int tilesDown = 1;
+    while ((tileHeight * tilesDown) % 4 || tileHeight * tilesDown < 64)
+        tilesDown *= 2;
+
+    const int width = tileWidth * tilesAcross;
+    const int height = tileHeight * tilesDown;
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+
+    const QRgb gridColor = qRgba(0, 0, 0, 128);
+
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const bool dashedRow = y % tileHeight == 0;
+        const bool dashOn = y % 4 < 2;
+
+        for (int x = 0; x < width; ++x) {
+            if ((dashedRow && x % 4 < 2) || (x % tileWidth == 0 && dashOn))
+                line[x] = gridColor;
+        }
     }
+
+    mGridPattern = QPixmap::fromImage(image);
+    mGridPatternTileSize = tileSize;
+    return mGridPattern;
 }
 
 void OrthogonalRenderer::drawTileLayer(QPainter *painter,
                                        const TileLayer *layer,
-                                       const QRectF &exposed) const
+                                       const QRectF &exposed,
+                                       const QBitArray *coveredCells) const
 {
     const int tileWidth = map()->tileWidth();
     const int tileHeight = map()->tileHeight();
@@ -202,19 +276,23 @@ void OrthogonalRenderer::drawTileLayer(QPainter *painter,
         endY = qMin((int) std::ceil(rect.bottom()) / tileHeight + 1, endY);
     }
 
+    CellRenderer renderer(painter);
+
     for (int y = startY; y < endY; ++y) {
         for (int x = startX; x < endX; ++x) {
             const Cell &cell = layer->cellAt(x, y);
             if (cell.isEmpty())
                 continue;
+            if (coveredCells && coveredCells->testBit(x + y * layer->width()))
+                continue;
 
-            const QImage qimg = cell.toImage();
-            const QPoint qpos(x * tileWidth,
-                             (y + 1)* tileHeight - qimg.height());
-            painter->drawImage(qpos, qimg);
+            renderer.render(cell, QPointF(x * tileWidth,
+                                          (y + 1) * tileHeight));
         }
     }
 
+    renderer.flush();
+
     painter->translate(-layerPos);
 }
 
@@ -230,6 +308,39 @@ void OrthogonalRenderer::drawTileSelection(QPainter *painter,
     }
 }
 
+void OrthogonalRenderer::drawTileMask(QPainter *painter,
+                                      const QImage &mask,
+                                      const QPoint &pos,
+                                      const QRectF &exposed) const
+{
+    const int tileWidth = map()->tileWidth();
+    const int tileHeight = map()->tileHeight();
+
+    if (tileWidth <= 0 || tileHeight <= 0)
+        return;
+
+    QRect tiles(pos, mask.size());
+
+    if (!exposed.isNull()) {
+        const QPoint topLeft((int) std::floor(exposed.left() / tileWidth),
+                             (int) std::floor(exposed.top() / tileHeight));
+        const QPoint bottomRight(
+                (int) std::floor(exposed.right() / tileWidth),
+                (int) std::floor(exposed.bottom() / tileHeight));
+        tiles &= QRect(topLeft, bottomRight);
+    }
+
+    if (tiles.isEmpty())
+        return;
+
+    // Scale up the pixels without blurring their edges
+    painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter->drawImage(QRectF(boundingRect(tiles)), mask,
+                       QRectF(tiles.translated(-pos)));
+    painter->restore();
+}
+
 void OrthogonalRenderer::drawMapObject(QPainter *painter,
                                        const MapObject *object,
                                        const QColor &color) const
@@ -248,11 +359,12 @@ void OrthogonalRenderer::drawMapObjectDecorate(QPainter *painter,
     QRectF rect(tileToPixelCoords(bounds.topLeft()),
                 tileToPixelCoords(bounds.bottomRight()));
 
-    painter->translate(rect.topLeft());
+    const QPointF pixelPos = rect.topLeft();
+    painter->translate(pixelPos);
     rect.moveTopLeft(QPointF(0, 0));
 
     if (object->tile()) {
-        const QImage img = object->toImage();
+        const QImage img = objectImage(object);
         const QPoint paintOrigin(0, -img.height());
         painter->drawImage(paintOrigin, img);
 
@@ -300,7 +412,8 @@ void OrthogonalRenderer::drawMapObjectDecorate(QPainter *painter,
         }
 
         case MapObject::Polyline: {
-            QPolygonF screenPolygon = tileToPixelCoords(object->polygon());
+            const QPolygonF screenPolygon =
+                    this->screenPolygon(object).translated(-pixelPos);
 
             painter->setPen(shadowPen);
             painter->drawPolyline(screenPolygon.translated(1, 1));
@@ -312,7 +425,8 @@ void OrthogonalRenderer::drawMapObjectDecorate(QPainter *painter,
         }
 
         case MapObject::Polygon: {
-            QPolygonF screenPolygon = tileToPixelCoords(object->polygon());
+            const QPolygonF screenPolygon =
+                    this->screenPolygon(object).translated(-pixelPos);
 
             painter->setPen(shadowPen);
             painter->drawPolygon(screenPolygon.translated(1, 1));
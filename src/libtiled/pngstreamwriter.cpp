@@ -0,0 +1,365 @@
+/*
+ * pngstreamwriter.cpp
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pngstreamwriter.h"
+
+#include <zlib.h>
+#include <QCoreApplication>
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+// The amount of compressed data written per IDAT chunk
+static const int OUTPUT_SIZE = 64 * 1024;
+
+namespace Tiled {
+namespace Internal {
+
+class PngStreamWriterPrivate
+{
+public:
+    PngStreamWriterPrivate()
+        : mFile(0)
+        , mOpen(false)
+        , mRowsWritten(0)
+    {}
+
+    bool writeChunk(const char *type, const char *data, uint length);
+    bool compress(const uchar *data, uint length, int flush);
+    bool flushOutput();
+    bool fail(const QString &error);
+    void cleanUp();
+
+    QTemporaryFile *mFile;  // Replaces the target file when completed
+    QString mFileName;
+    bool mOpen;
+    int mWidth;
+    int mHeight;
+    int mRowsWritten;
+    z_stream mStream;
+    QByteArray mRow;
+    QByteArray mOutput;
+    QString mError;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+bool PngStreamWriterPrivate::writeChunk(const char *type,
+                                        const char *data, uint length)
+{
+    uchar header[8];
+    qToBigEndian<quint32>(length, header);
+    std::memcpy(header + 4, type, 4);
+
+    uLong crc = crc32(0, header + 4, 4);
+    if (length > 0)
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), length);
+
+    uchar footer[4];
+    qToBigEndian<quint32>(crc, footer);
+
+    if (mFile->write(reinterpret_cast<const char*>(header), 8) != 8
+            || (length > 0 && mFile->write(data, length) != qint64(length))
+            || mFile->write(reinterpret_cast<const char*>(footer), 4) != 4) {
+        return fail(mFile->errorString());
+    }
+
+    return true;
+}
+
+/**
+ * Feeds the given data to deflate, writing out an IDAT chunk each time the
+ * output buffer is full.
+ */
+bool PngStreamWriterPrivate::compress(const uchar *data, uint length,
+                                      int flush)
+{
+    mStream.next_in = const_cast<Bytef*>(data);
+    mStream.avail_in = length;
+
+    forever {
+        const int result = deflate(&mStream, flush);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            return fail(QCoreApplication::translate(
+                            "PngStreamWriter",
+                            "Error while compressing the image data."));
+
+        if (mStream.avail_out == 0) {
+            if (!flushOutput())
+                return false;
+            continue;
+        }
+
+        // There was room left, so all of the input was consumed
+        if (flush != Z_FINISH || result == Z_STREAM_END)
+            return true;
+    }
+}
+
+bool PngStreamWriterPrivate::flushOutput()
+{
+    const uint length = OUTPUT_SIZE - mStream.avail_out;
+
+    mStream.next_out = reinterpret_cast<Bytef*>(mOutput.data());
+    mStream.avail_out = OUTPUT_SIZE;
+
+    if (length == 0)
+        return true;
+
+    return writeChunk("IDAT", mOutput.constData(), length);
+}
+
+bool PngStreamWriterPrivate::fail(const QString &error)
+{
+    mError = error;
+    return false;
+}
+
+void PngStreamWriterPrivate::cleanUp()
+{
+    if (!mOpen)
+        return;
+
+    deflateEnd(&mStream);
+    mFile->close();
+    mRow.clear();
+    mOutput.clear();
+    mOpen = false;
+}
+
+/**
+ * Replaces the file at \a to with the file at \a from, in a single step
+ * where the platform supports it.
+ */
+static bool replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t*>(from.utf16()),
+                       reinterpret_cast<const wchar_t*>(to.utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    return ::rename(QFile::encodeName(from).constData(),
+                    QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+
+PngStreamWriter::PngStreamWriter()
+    : d(new PngStreamWriterPrivate)
+{
+}
+
+PngStreamWriter::~PngStreamWriter()
+{
+    abort();
+    delete d;
+}
+
+bool PngStreamWriter::open(const QString &fileName, const QSize &size)
+{
+    abort();
+
+    if (size.isEmpty())
+        return d->fail(QCoreApplication::translate("PngStreamWriter",
+                                                   "Invalid image size."));
+
+    // The image is written to a temporary file next to the target, so that
+    // an existing image is only replaced once the new one is complete
+    d->mFile = new QTemporaryFile(fileName + QLatin1String(".XXXXXX"));
+    if (!d->mFile->open()) {
+        d->fail(d->mFile->errorString());
+        delete d->mFile;
+        d->mFile = 0;
+        return false;
+    }
+
+    std::memset(&d->mStream, 0, sizeof(z_stream));
+    if (deflateInit(&d->mStream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        delete d->mFile;
+        d->mFile = 0;
+        return d->fail(QCoreApplication::translate("PngStreamWriter",
+                                                   "Out of memory."));
+    }
+
+    d->mFileName = fileName;
+    d->mOpen = true;
+    d->mWidth = size.width();
+    d->mHeight = size.height();
+    d->mRowsWritten = 0;
+    d->mRow.resize(1 + d->mWidth * 4);
+    d->mOutput.resize(OUTPUT_SIZE);
+    d->mStream.next_out = reinterpret_cast<Bytef*>(d->mOutput.data());
+    d->mStream.avail_out = OUTPUT_SIZE;
+
+    static const char signature[] = "\x89PNG\r\n\x1a\n";
+
+    uchar header[13];
+    qToBigEndian<quint32>(d->mWidth, header);
+    qToBigEndian<quint32>(d->mHeight, header + 4);
+    header[8] = 8;      // Bit depth
+    header[9] = 6;      // Color type: RGBA
+    header[10] = 0;     // Compression method: deflate
+    header[11] = 0;     // Filter method: adaptive
+    header[12] = 0;     // No interlacing
+
+    if (d->mFile->write(signature, 8) != 8) {
+        d->fail(d->mFile->errorString());
+        abort();
+        return false;
+    }
+
+    if (!d->writeChunk("IHDR", reinterpret_cast<const char*>(header), 13)) {
+        abort();
+        return false;
+    }
+
+    return true;
+}
+
+bool PngStreamWriter::writeRows(const QImage &image)
+{
+    if (!d->mOpen)
+        return d->fail(QCoreApplication::translate("PngStreamWriter",
+                                                   "No image is open."));
+
+    if (image.width() != d->mWidth
+            || d->mRowsWritten + image.height() > d->mHeight) {
+        return d->fail(QCoreApplication::translate("PngStreamWriter",
+                                                   "Rows don't fit image."));
+    }
+
+    const QImage argb = image.format() == QImage::Format_ARGB32
+            ? image : image.convertToFormat(QImage::Format_ARGB32);
+
+    uchar *row = reinterpret_cast<uchar*>(d->mRow.data());
+    const int rowLength = d->mRow.size();
+
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(argb.scanLine(y));
+
+        uchar *pixel = row + 1;
+        for (int x = 0; x < d->mWidth; ++x, pixel += 4) {
+            const QRgb color = line[x];
+            pixel[0] = qRed(color);
+            pixel[1] = qGreen(color);
+            pixel[2] = qBlue(color);
+            pixel[3] = qAlpha(color);
+        }
+
+        // Apply the Sub filter, which stores each byte as the difference
+        // with the one of the pixel to its left
+        row[0] = 1;
+        for (int i = rowLength - 1; i > 4; --i)
+            row[i] -= row[i - 4];
+
+        if (!d->compress(row, rowLength, Z_NO_FLUSH))
+            return false;
+    }
+
+    d->mRowsWritten += argb.height();
+    return true;
+}
+
+bool PngStreamWriter::close()
+{
+    if (!d->mOpen)
+        return d->fail(QCoreApplication::translate("PngStreamWriter",
+                                                   "No image is open."));
+
+    if (d->mRowsWritten != d->mHeight) {
+        d->fail(QCoreApplication::translate("PngStreamWriter",
+                                            "Not all rows were written."));
+        abort();
+        return false;
+    }
+
+    if (!d->compress(0, 0, Z_FINISH) || !d->flushOutput()
+            || !d->writeChunk("IEND", 0, 0)) {
+        abort();
+        return false;
+    }
+
+    d->cleanUp();
+
+    QTemporaryFile *file = d->mFile;
+    d->mFile = 0;
+
+    if (file->error() != QFile::NoError) {
+        d->fail(file->errorString());
+        delete file;
+        return false;
+    }
+
+    // Temporary files are only accessible by the owner
+    const QFile::Permissions permissions = QFile::exists(d->mFileName)
+            ? QFile::permissions(d->mFileName)
+            : QFile::ReadOwner | QFile::WriteOwner | QFile::ReadUser |
+              QFile::WriteUser | QFile::ReadGroup | QFile::ReadOther;
+    file->setPermissions(permissions);
+
+    if (!replaceFile(file->fileName(), d->mFileName)) {
+        d->fail(QCoreApplication::translate("PngStreamWriter",
+                                            "Could not replace %1.")
+                .arg(d->mFileName));
+        delete file;
+        return false;
+    }
+
+    file->setAutoRemove(false);
+    delete file;
+    return true;
+}
+
+void PngStreamWriter::abort()
+{
+    if (!d->mOpen)
+        return;
+
+    // Removes the temporary file, leaving any existing image untouched
+    d->cleanUp();
+    delete d->mFile;
+    d->mFile = 0;
+}
+
+QString PngStreamWriter::errorString() const
+{
+    return d->mError;
+}
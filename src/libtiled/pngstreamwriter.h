@@ -0,0 +1,103 @@
+/*
+ * pngstreamwriter.h
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PNGSTREAMWRITER_H
+#define PNGSTREAMWRITER_H
+
+#include "tiled_global.h"
+
+#include <QString>
+
+class QImage;
+class QSize;
+
+namespace Tiled {
+
+namespace Internal {
+class PngStreamWriterPrivate;
+}
+
+/**
+ * Writes a PNG image a number of rows at a time. The rows are compressed
+ * and written out as they come in, so that images can be written that are
+ * too large to be kept in memory as a whole.
+ *
+ * The image is stored as 8-bit RGBA.
+ */
+class TILEDSHARED_EXPORT PngStreamWriter
+{
+public:
+    PngStreamWriter();
+
+    /**
+     * Destructor. Discards the image when it was not completed with close().
+     */
+    ~PngStreamWriter();
+
+    /**
+     * Starts writing an image of the given \a size to \a fileName. The image
+     * is written to a temporary file, which only replaces \a fileName once
+     * it is completed by close().
+     *
+     * Returns false and sets errorString() when opening the file failed.
+     */
+    bool open(const QString &fileName, const QSize &size);
+
+    /**
+     * Appends the rows of the given \a image, which needs to be as wide as
+     * the image being written.
+     *
+     * Returns false and sets errorString() when writing failed.
+     */
+    bool writeRows(const QImage &image);
+
+    /**
+     * Finishes writing the image, which fails when not all of its rows were
+     * written.
+     *
+     * Returns false and sets errorString() when writing failed.
+     */
+    bool close();
+
+    /**
+     * Stops writing the image and removes the incomplete temporary file. An
+     * existing file at the target location is left untouched.
+     */
+    void abort();
+
+    /**
+     * Returns the error message for the last occurred error.
+     */
+    QString errorString() const;
+
+private:
+    Internal::PngStreamWriterPrivate *d;
+};
+
+} // namespace Tiled
+
+#endif // PNGSTREAMWRITER_H
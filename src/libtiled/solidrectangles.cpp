@@ -0,0 +1,112 @@
+/*
+ * solidrectangles.cpp
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "solidrectangles.h"
+
+#include "mapobject.h"
+#include "objectgroup.h"
+#include "tilelayer.h"
+
+using namespace Tiled;
+
+QVector<QRect> Tiled::solidRectangles(const TileLayer *tileLayer,
+                                      CellPredicate isSolid)
+{
+    QVector<QRect> rectangles;
+
+    // The rectangles that reach down to the previous row, ordered by x
+    QVector<int> open;
+    QVector<int> nextOpen;
+
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+
+    for (int y = 0; y < height; ++y) {
+        int openIndex = 0;
+        int x = 0;
+
+        while (x < width) {
+            const Cell &cell = tileLayer->cellAt(x, y);
+            if (isSolid ? !isSolid(cell) : cell.isEmpty()) {
+                ++x;
+                continue;
+            }
+
+            // Find the end of this span of solid cells
+            const int start = x;
+            for (++x; x < width; ++x) {
+                const Cell &next = tileLayer->cellAt(x, y);
+                if (isSolid ? !isSolid(next) : next.isEmpty())
+                    break;
+            }
+            const int spanWidth = x - start;
+
+            while (openIndex < open.size()
+                   && rectangles.at(open.at(openIndex)).x() < start)
+                ++openIndex;
+
+            if (openIndex < open.size()) {
+                QRect &above = rectangles[open.at(openIndex)];
+                if (above.x() == start && above.width() == spanWidth) {
+                    above.setBottom(y);
+                    nextOpen.append(open.at(openIndex));
+                    ++openIndex;
+                    continue;
+                }
+            }
+
+            nextOpen.append(rectangles.size());
+            rectangles.append(QRect(start, y, spanWidth, 1));
+        }
+
+        qSwap(open, nextOpen);
+        nextOpen.clear();
+    }
+
+    return rectangles;
+}
+
+ObjectGroup *Tiled::solidRectanglesObjectGroup(const TileLayer *tileLayer,
+                                               CellPredicate isSolid)
+{
+    ObjectGroup *objectGroup = new ObjectGroup(tileLayer->name(),
+                                               tileLayer->x(),
+                                               tileLayer->y(),
+                                               tileLayer->width(),
+                                               tileLayer->height());
+
+    const QString type = QLatin1String("collision");
+    const QPoint offset = tileLayer->position();
+
+    foreach (const QRect &rect, solidRectangles(tileLayer, isSolid)) {
+        objectGroup->addObject(new MapObject(QString(), type,
+                                             rect.topLeft() + offset,
+                                             rect.size()));
+    }
+
+    return objectGroup;
+}
@@ -0,0 +1,71 @@
+/*
+ * solidrectangles.h
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SOLIDRECTANGLES_H
+#define SOLIDRECTANGLES_H
+
+#include "tiled_global.h"
+
+#include <QRect>
+#include <QVector>
+
+namespace Tiled {
+
+class Cell;
+class ObjectGroup;
+class TileLayer;
+
+/**
+ * A function that returns whether the given cell is solid.
+ */
+typedef bool (*CellPredicate)(const Cell &cell);
+
+/**
+ * Covers the solid cells of \a tileLayer with non-overlapping rectangles,
+ * in local cell coordinates. When no \a isSolid predicate is given, all
+ * non-empty cells are solid.
+ *
+ * Each row is split into spans of solid cells, and a span is merged with
+ * the rectangle directly above it when they have the same horizontal
+ * extent. This takes a single pass over the layer and usually produces far
+ * fewer rectangles than there are solid cells.
+ */
+TILEDSHARED_EXPORT QVector<QRect> solidRectangles(const TileLayer *tileLayer,
+                                                  CellPredicate isSolid = 0);
+
+/**
+ * Returns a new object group with an object for each of the rectangles
+ * covering the solid cells of \a tileLayer. The objects have the type
+ * "collision". The caller takes ownership of the object group.
+ */
+TILEDSHARED_EXPORT ObjectGroup *solidRectanglesObjectGroup(
+        const TileLayer *tileLayer,
+        CellPredicate isSolid = 0);
+
+} // namespace Tiled
+
+#endif // SOLIDRECTANGLES_H
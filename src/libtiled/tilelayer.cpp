@@ -33,19 +33,71 @@
 #include "tile.h"
 #include "tileset.h"
 
+#include <QAtomicInt>
+#include <QDebug>
+
 using namespace Tiled;
 
 TileLayer::TileLayer(const QString &name, int x, int y, int width, int height):
     Layer(name, x, y, width, height),
     mMaxTileSize(0, 0),
-    mGrid(width * height)
+    mGrid(width * height),
+    mDecoder(0),
+    mGeneration(0)
 {
     Q_ASSERT(width >= 0);
     Q_ASSERT(height >= 0);
 }
 
+TileLayer::~TileLayer()
+{
+    delete mDecoder;
+}
+
+void TileLayer::setDeferredDecoder(TileLayerDecoder *decoder)
+{
+    delete mDecoder;
+    mDecoder = decoder;
+}
+
+/**
+ * Runs the deferred decoder. This is logically const, since to the outside
+ * the layer looks like it has been decoded all along.
+ */
+void TileLayer::decodeDeferred() const
+{
+    TileLayer *self = const_cast<TileLayer*>(this);
+
+    // Reset first, since the decoder accesses the layer through setCell
+    TileLayerDecoder *decoder = self->mDecoder;
+    self->mDecoder = 0;
+
+    if (!decoder->decode(self, &self->mDecodingError)) {
+        qWarning() << "Error while decoding layer data:"
+                   << self->mDecodingError;
+    }
+    delete decoder;
+}
+
+uint TileLayer::generation() const
+{
+    static QAtomicInt lastGeneration;
+
+    // Generations are only handed out on request, so that changing a cell
+    // only needs to reset the generation
+    if (mGeneration == 0) {
+        do {
+            mGeneration = uint(lastGeneration.fetchAndAddRelaxed(1) + 1);
+        } while (mGeneration == 0);
+    }
+
+    return mGeneration;
+}
+
 QRegion TileLayer::region() const
 {
+    ensureDecoded();
+
     QRegion region;
 
     for (int y = 0; y < mHeight; ++y) {
@@ -70,6 +122,7 @@ QRegion TileLayer::region() const
 void TileLayer::setCell(int x, int y, const Cell &cell)
 {
     Q_ASSERT(contains(x, y));
+    ensureDecoded();
 
     if (cell.tile) {
         if (cell.tile->width() > mMaxTileSize.width()) {
@@ -85,6 +138,7 @@ void TileLayer::setCell(int x, int y, const Cell &cell)
     }
 
     mGrid[x + y * mWidth] = cell;
+    mGeneration = 0;
 }
 
 TileLayer *TileLayer::copy(const QRegion &region) const
@@ -143,6 +197,8 @@ void TileLayer::setCells(int x, int y, TileLayer *layer,
 
 void TileLayer::flip(FlipDirection direction)
 {
+    ensureDecoded();
+
     QVector<Cell> newGrid(mWidth * mHeight);
 
     for (int y = 0; y < mHeight; ++y) {
@@ -161,10 +217,13 @@ void TileLayer::flip(FlipDirection direction)
     }
 
     mGrid = newGrid;
+    mGeneration = 0;
 }
 
 QSet<Tileset*> TileLayer::usedTilesets() const
 {
+    ensureDecoded();
+
     QSet<Tileset*> tilesets;
 
     for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
@@ -176,6 +235,8 @@ QSet<Tileset*> TileLayer::usedTilesets() const
 
 bool TileLayer::referencesTileset(const Tileset *tileset) const
 {
+    ensureDecoded();
+
     for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
         const Tile *tile = mGrid.at(i).tile;
         if (tile && tile->tileset() == tileset)
@@ -186,6 +247,8 @@ bool TileLayer::referencesTileset(const Tileset *tileset) const
 
 QRegion TileLayer::tilesetReferences(Tileset *tileset) const
 {
+    ensureDecoded();
+
     QRegion region;
 
     for (int y = 0; y < mHeight; ++y)
@@ -199,25 +262,35 @@ QRegion TileLayer::tilesetReferences(Tileset *tileset) const
 
 void TileLayer::removeReferencesToTileset(Tileset *tileset)
 {
+    ensureDecoded();
+
     for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
         const Tile *tile = mGrid.at(i).tile;
         if (tile && tile->tileset() == tileset)
             mGrid.replace(i, Cell());
     }
+
+    mGeneration = 0;
 }
 
 void TileLayer::replaceReferencesToTileset(Tileset *oldTileset,
                                            Tileset *newTileset)
 {
+    ensureDecoded();
+
     for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
         const Tile *tile = mGrid.at(i).tile;
         if (tile && tile->tileset() == oldTileset)
             mGrid[i].tile = newTileset->tileAt(tile->id());
     }
+
+    mGeneration = 0;
 }
 
 void TileLayer::resize(const QSize &size, const QPoint &offset)
 {
+    ensureDecoded();
+
     QVector<Cell> newGrid(size.width() * size.height());
 
     // Copy over the preserved part
@@ -234,6 +307,7 @@ void TileLayer::resize(const QSize &size, const QPoint &offset)
     }
 
     mGrid = newGrid;
+    mGeneration = 0;
     Layer::resize(size, offset);
 }
 
@@ -241,6 +315,8 @@ void TileLayer::offset(const QPoint &offset,
                        const QRect &bounds,
                        bool wrapX, bool wrapY)
 {
+    ensureDecoded();
+
     QVector<Cell> newGrid(mWidth * mHeight);
 
     for (int y = 0; y < mHeight; ++y) {
@@ -280,6 +356,7 @@ void TileLayer::offset(const QPoint &offset,
     }
 
     mGrid = newGrid;
+    mGeneration = 0;
 }
 
 bool TileLayer::canMergeWith(Layer *other) const
@@ -329,6 +406,8 @@ QRegion TileLayer::computeDiffRegion(const TileLayer *other) const
 
 bool TileLayer::isEmpty() const
 {
+    ensureDecoded();
+
     for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
         if (!mGrid.at(i).isEmpty())
             return false;
@@ -348,8 +427,11 @@ Layer *TileLayer::clone() const
 
 TileLayer *TileLayer::initializeClone(TileLayer *clone) const
 {
+    ensureDecoded();
     Layer::initializeClone(clone);
     clone->mGrid = mGrid;
     clone->mMaxTileSize = mMaxTileSize;
+    clone->mDecodingError = mDecodingError;
+    clone->mGeneration = generation();  // Same contents, same generation
     return clone;
 }
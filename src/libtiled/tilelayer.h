@@ -41,8 +41,27 @@
 namespace Tiled {
 
 class Tile;
+class TileLayer;
 class Tileset;
 
+/**
+ * Fills in the cells of a tile layer whose decoding was deferred until its
+ * cells are first accessed.
+ *
+ * \sa TileLayer::setDeferredDecoder()
+ */
+class TILEDSHARED_EXPORT TileLayerDecoder
+{
+public:
+    virtual ~TileLayerDecoder() {}
+
+    /**
+     * Sets the cells of the given \a tileLayer. Returns false and sets
+     * \a error when the data could not be decoded.
+     */
+    virtual bool decode(TileLayer *tileLayer, QString *error) = 0;
+};
+
 /**
  * A cell on a tile layer grid.
  */
@@ -127,12 +146,62 @@ public:
      */
     TileLayer(const QString &name, int x, int y, int width, int height);
 
+    /**
+     * Destructor.
+     */
+    ~TileLayer();
+
     /**
      * Returns the maximum tile size of this layer. Used by the layer
      * rendering code to determine the area that needs to be redrawn.
      */
     QSize maxTileSize() const { return mMaxTileSize; }
 
+    /**
+     * Sets the \a decoder that fills in the cells of this layer. Decoding is
+     * deferred until the cells are first accessed. The layer takes ownership
+     * of the decoder.
+     *
+     * Until the layer is decoded, maxTileSize() does not account for the
+     * tiles on this layer.
+     */
+    void setDeferredDecoder(TileLayerDecoder *decoder);
+
+    /**
+     * Returns whether decoding of the cells of this layer is still pending.
+     */
+    bool isDecodingDeferred() const { return mDecoder != 0; }
+
+    /**
+     * Decodes the cells of this layer now when decoding was deferred. Since
+     * decoding modifies the layer, this needs to be called before the layer
+     * is read from multiple threads.
+     */
+    void ensureDecoded() const
+    { if (mDecoder) decodeDeferred(); }
+
+    /**
+     * Returns the error that occurred while decoding the cells of this
+     * layer, or an empty string when decoding succeeded. Decodes the layer
+     * first when needed.
+     *
+     * A layer that failed to decode is missing some or all of its cells, so
+     * it should not be saved over the original data.
+     */
+    QString decodingError() const
+    { ensureDecoded(); return mDecodingError; }
+
+    /**
+     * Returns a number that changes whenever the cells of this layer change.
+     * Generations are unique among all tile layers, so a layer together
+     * with its generation identifies the contents of the layer. This allows
+     * caching data derived from the cells, like the encoded layer data.
+     *
+     * A clone shares the generation of the layer it was cloned from, until
+     * either of them is changed.
+     */
+    uint generation() const;
+
     /**
      * Returns whether (x, y) is inside this map layer.
      */
@@ -153,7 +222,7 @@ public:
      * coordinates have to be within this layer.
      */
     const Cell &cellAt(int x, int y) const
-    { return mGrid.at(x + y * mWidth); }
+    { ensureDecoded(); return mGrid.at(x + y * mWidth); }
 
     const Cell &cellAt(const QPoint &point) const
     { return cellAt(point.x(), point.y()); }
@@ -262,8 +331,13 @@ protected:
     TileLayer *initializeClone(TileLayer *clone) const;
 
 private:
+    void decodeDeferred() const;
+
     QSize mMaxTileSize;
     QVector<Cell> mGrid;
+    TileLayerDecoder *mDecoder;
+    QString mDecodingError;
+    mutable uint mGeneration;   // 0 when changed since the last generation()
 };
 
 } // namespace Tiled
@@ -51,6 +51,13 @@ bool Tileset::loadFromImage(const QImage &image, const QString &fileName)
     if (image.isNull())
         return false;
 
+    QPixmap imagePixmap = QPixmap::fromImage(image);
+    if (mTransparentColor.isValid()) {
+        const QImage mask =
+                image.createMaskFromColor(mTransparentColor.rgb());
+        imagePixmap.setMask(QBitmap::fromImage(mask));
+    }
+
     const int stopWidth = image.width() - mTileWidth;
     const int stopHeight = image.height() - mTileHeight;
 
@@ -77,6 +84,8 @@ bool Tileset::loadFromImage(const QImage &image, const QString &fileName)
         }
     }
 
+    const int imageTileCount = tileNum;
+
     // Blank out any remaining tiles to avoid confusion
     while (tileNum < oldTilesetSize) {
         QPixmap tilePixmap = QPixmap(mTileWidth, mTileHeight);
@@ -88,10 +97,25 @@ bool Tileset::loadFromImage(const QImage &image, const QString &fileName)
     mImageWidth = image.width();
     mImageHeight = image.height();
     mColumnCount = columnCountForWidth(mImageWidth);
+    mImage = imagePixmap;
+    mImageTileCount = imageTileCount;
     mImageSource = fileName;
     return true;
 }
 
+QRect Tileset::tileRect(int id) const
+{
+    if (id < 0 || id >= mImageTileCount)
+        return QRect();
+
+    const int column = id % mColumnCount;
+    const int row = id / mColumnCount;
+
+    return QRect(mMargin + column * (mTileWidth + mTileSpacing),
+                 mMargin + row * (mTileHeight + mTileSpacing),
+                 mTileWidth, mTileHeight);
+}
+
 Tileset *Tileset::findSimilarTileset(const QList<Tileset*> &tilesets) const
 {
     foreach (Tileset *candidate, tilesets) {
@@ -34,6 +34,8 @@
 
 #include <QColor>
 #include <QList>
+#include <QPixmap>
+#include <QRect>
 #include <QString>
 
 class QImage;
@@ -69,7 +71,8 @@ public:
         mMargin(margin),
         mImageWidth(0),
         mImageHeight(0),
-        mColumnCount(0)
+        mColumnCount(0),
+        mImageTileCount(0)
     {
         Q_ASSERT(tileSpacing >= 0);
         Q_ASSERT(margin >= 0);
@@ -153,6 +156,20 @@ public:
      */
     int imageHeight() const { return mImageHeight; }
 
+    /**
+     * Returns the tileset image as loaded by loadFromImage(), with the
+     * transparent color masked out. Drawing tiles from this image instead of
+     * from their own images allows different tiles to be drawn in a single
+     * call. Is a null pixmap when the tileset has no image.
+     */
+    const QPixmap &image() const { return mImage; }
+
+    /**
+     * Returns the area of the tile with the given \a id within image(), or
+     * an empty rectangle when the tile is not part of the image.
+     */
+    QRect tileRect(int id) const;
+
     /**
      * Returns the transparent color, or an invalid color if no transparent
      * color is used.
@@ -213,6 +230,8 @@ private:
     int mImageWidth;
     int mImageHeight;
     int mColumnCount;
+    QPixmap mImage;
+    int mImageTileCount;
     QList<Tile*> mTiles;
 };
 
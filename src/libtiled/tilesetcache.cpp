@@ -0,0 +1,94 @@
+/*
+ * tilesetcache.cpp
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tilesetcache.h"
+
+#include "mapreader.h"
+#include "tileset.h"
+
+#include <QFileInfo>
+
+using namespace Tiled;
+
+TilesetCache::TilesetCache()
+{
+}
+
+TilesetCache::~TilesetCache()
+{
+    foreach (const Entry &entry, mEntries)
+        delete entry.tileset;
+    qDeleteAll(mReplacedTilesets);
+}
+
+Tileset *TilesetCache::tileset(const QString &fileName, QString *error)
+{
+    const QFileInfo fileInfo(fileName);
+    QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty()) // The file does not exist
+        canonicalPath = fileName;
+
+    const QDateTime lastModified = fileInfo.lastModified();
+
+    QHash<QString, Entry>::iterator it = mEntries.find(canonicalPath);
+    if (it != mEntries.end() && it.value().lastModified == lastModified)
+        return it.value().tileset;
+
+    MapReader reader;
+    Tileset *tileset = reader.readTileset(fileName);
+    if (!tileset) {
+        if (error)
+            *error = reader.errorString();
+        return 0;
+    }
+
+    if (it != mEntries.end()) {
+        mReplacedTilesets.append(it.value().tileset);
+        mEntries.erase(it);
+    }
+
+    Entry entry;
+    entry.tileset = tileset;
+    entry.lastModified = lastModified;
+    mEntries.insert(canonicalPath, entry);
+
+    return tileset;
+}
+
+bool TilesetCache::contains(const Tileset *tileset) const
+{
+    foreach (const Entry &entry, mEntries)
+        if (entry.tileset == tileset)
+            return true;
+
+    return mReplacedTilesets.contains(const_cast<Tileset*>(tileset));
+}
+
+int TilesetCache::count() const
+{
+    return mEntries.size();
+}
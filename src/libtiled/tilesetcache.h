@@ -0,0 +1,100 @@
+/*
+ * tilesetcache.h
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILESETCACHE_H
+#define TILESETCACHE_H
+
+#include "tiled_global.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+namespace Tiled {
+
+class Tileset;
+
+/**
+ * A cache of external tilesets, which can be shared between MapReader
+ * instances so that each tileset file is only read once. This is mainly
+ * useful when processing many maps that refer to the same tilesets.
+ *
+ * Tilesets are identified by their canonical file path and are read again
+ * when the file has been modified since it was cached.
+ *
+ * The cache owns the tilesets it returns, so they should not be deleted
+ * along with the maps using them. Tilesets that have been replaced by a more
+ * recent version stay around until the cache is destroyed, since maps may
+ * still be referring to them.
+ *
+ * Reading a tileset creates pixmaps for its tiles, so the cache may only be
+ * used from the GUI thread.
+ */
+class TILEDSHARED_EXPORT TilesetCache
+{
+public:
+    TilesetCache();
+
+    /**
+     * Destructor. Deletes all cached tilesets.
+     */
+    ~TilesetCache();
+
+    /**
+     * Returns the tileset stored in the given \a fileName, reading it when
+     * it is not in the cache yet or when the file has changed.
+     *
+     * Returns 0 and sets \a error when the tileset could not be read.
+     */
+    Tileset *tileset(const QString &fileName, QString *error = 0);
+
+    /**
+     * Returns whether the given \a tileset is owned by this cache.
+     */
+    bool contains(const Tileset *tileset) const;
+
+    /**
+     * Returns the number of tilesets currently cached.
+     */
+    int count() const;
+
+private:
+    Q_DISABLE_COPY(TilesetCache)
+
+    struct Entry {
+        Tileset *tileset;
+        QDateTime lastModified;
+    };
+
+    QHash<QString, Entry> mEntries;
+    QList<Tileset*> mReplacedTilesets;
+};
+
+} // namespace Tiled
+
+#endif // TILESETCACHE_H
@@ -0,0 +1,153 @@
+/*
+ * Baked Lua Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atlaspacker.h"
+
+#include <QtAlgorithms>
+
+using namespace Bake;
+
+namespace {
+
+int nextPowerOfTwo(int value)
+{
+    int result = 1;
+    while (result < value)
+        result *= 2;
+    return result;
+}
+
+/**
+ * Orders rectangle indexes by decreasing height, and by decreasing width
+ * for rectangles of equal height.
+ */
+class ByHeight
+{
+public:
+    ByHeight(const QList<QSize> &sizes) : mSizes(sizes) {}
+
+    bool operator() (int a, int b) const
+    {
+        const QSize &sa = mSizes.at(a);
+        const QSize &sb = mSizes.at(b);
+        if (sa.height() != sb.height())
+            return sa.height() > sb.height();
+        return sa.width() > sb.width();
+    }
+
+private:
+    const QList<QSize> &mSizes;
+};
+
+} // anonymous namespace
+
+AtlasPacker::AtlasPacker(int maximumSize, int padding)
+    : mMaximumSize(maximumSize)
+    , mPadding(padding)
+{
+}
+
+bool AtlasPacker::pack(const QList<QSize> &sizes)
+{
+    mSizes.clear();
+    mPageSizes.clear();
+    mPages.fill(0, sizes.size());
+    mPositions.fill(QPoint(), sizes.size());
+
+    QList<int> remaining;
+    int largestSide = 0;
+
+    foreach (const QSize &size, sizes) {
+        const QSize padded = size + QSize(mPadding * 2, mPadding * 2);
+        largestSide = qMax(largestSide, qMax(padded.width(), padded.height()));
+        remaining.append(mSizes.size());
+        mSizes.append(padded);
+    }
+
+    if (largestSide > mMaximumSize)
+        return false;
+
+    qSort(remaining.begin(), remaining.end(), ByHeight(mSizes));
+
+    while (!remaining.isEmpty()) {
+        int area = 0;
+        foreach (int index, remaining)
+            area += mSizes.at(index).width() * mSizes.at(index).height();
+
+        // Start with the smallest square page that could hold the remaining
+        // rectangles and grow it as long as they don't all fit.
+        int size = nextPowerOfTwo(largestSide);
+        while (size * size < area && size < mMaximumSize)
+            size *= 2;
+
+        QList<int> indexes = remaining;
+        QSize used;
+        forever {
+            remaining.clear();
+            used = placeOnShelves(indexes, size, remaining);
+            if (remaining.isEmpty() || size >= mMaximumSize)
+                break;
+            size *= 2;
+        }
+
+        mPageSizes.append(QSize(nextPowerOfTwo(used.width()),
+                                nextPowerOfTwo(used.height())));
+    }
+
+    return true;
+}
+
+/**
+ * Places the rectangles at \a indexes on the next page, which is \a size
+ * pixels wide and high. The rectangles that don't fit are appended to
+ * \a remaining. Returns the area actually used on the page.
+ */
+QSize AtlasPacker::placeOnShelves(const QList<int> &indexes, int size,
+                                  QList<int> &remaining)
+{
+    const int page = mPageSizes.size();
+    int x = 0;
+    int y = 0;
+    int shelfHeight = 0;
+    QSize used;
+
+    foreach (int index, indexes) {
+        const QSize &padded = mSizes.at(index);
+
+        if (x + padded.width() > size) {
+            y += shelfHeight;
+            x = 0;
+            shelfHeight = 0;
+        }
+
+        if (y + padded.height() > size) {
+            remaining.append(index);
+            continue;
+        }
+
+        mPages[index] = page;
+        mPositions[index] = QPoint(x + mPadding, y + mPadding);
+
+        x += padded.width();
+        shelfHeight = qMax(shelfHeight, padded.height());
+        used = used.expandedTo(QSize(x, y + padded.height()));
+    }
+
+    return used;
+}
@@ -0,0 +1,77 @@
+/*
+ * Baked Lua Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ATLASPACKER_H
+#define ATLASPACKER_H
+
+#include <QList>
+#include <QPoint>
+#include <QSize>
+#include <QVector>
+
+namespace Bake {
+
+/**
+ * Packs rectangles into one or more atlas pages, which have power-of-two
+ * dimensions. The rectangles are placed on shelves, ordered by height.
+ */
+class AtlasPacker
+{
+public:
+    /**
+     * Constructor. The pages will be at most \a maximumSize pixels wide and
+     * high. Each rectangle is surrounded by a border of \a padding pixels.
+     */
+    AtlasPacker(int maximumSize, int padding);
+
+    /**
+     * Packs rectangles of the given \a sizes. Returns false when one of them
+     * does not fit on a page.
+     */
+    bool pack(const QList<QSize> &sizes);
+
+    int pageCount() const { return mPageSizes.size(); }
+    QSize pageSize(int page) const { return mPageSizes.at(page); }
+
+    /**
+     * Returns the page on which the rectangle at \a index was placed.
+     */
+    int page(int index) const { return mPages.at(index); }
+
+    /**
+     * Returns the top-left corner of the rectangle at \a index, excluding
+     * the padding.
+     */
+    QPoint position(int index) const { return mPositions.at(index); }
+
+private:
+    QSize placeOnShelves(const QList<int> &indexes, int size,
+                         QList<int> &remaining);
+
+    int mMaximumSize;
+    int mPadding;
+    QList<QSize> mSizes;
+    QVector<int> mPages;
+    QVector<QPoint> mPositions;
+    QList<QSize> mPageSizes;
+};
+
+} // namespace Bake
+
+#endif // ATLASPACKER_H
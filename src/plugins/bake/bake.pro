@@ -0,0 +1,15 @@
+include(../plugin.pri)
+
+DEFINES += BAKE_LIBRARY
+
+# Shares the Lua table writer with the Lua plugin
+INCLUDEPATH += ../lua
+DEPENDPATH += ../lua
+
+SOURCES += bakeplugin.cpp \
+    atlaspacker.cpp \
+    ../lua/luatablewriter.cpp
+HEADERS += bakeplugin.h\
+    bake_global.h \
+    atlaspacker.h \
+    ../lua/luatablewriter.h
@@ -0,0 +1,467 @@
+/*
+ * Baked Lua Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bakeplugin.h"
+
+#include "atlaspacker.h"
+#include "luatablewriter.h"
+
+#include "map.h"
+#include "mapobject.h"
+#include "objectgroup.h"
+#include "properties.h"
+#include "tile.h"
+#include "tilelayer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QtEndian>
+
+using namespace Bake;
+using namespace Lua;
+using namespace Tiled;
+
+namespace {
+
+// Atlas pages are never larger than this, since it's the maximum texture
+// size supported by most hardware
+const int MaximumAtlasSize = 2048;
+
+// The border around each tile, filled with its outermost pixels to avoid
+// neighbouring tiles bleeding in when the atlas is filtered
+const int TilePadding = 1;
+
+QString atlasFileName(const QString &baseName, int page)
+{
+    return baseName + QLatin1Char('_') + QString::number(page + 1)
+            + QLatin1String(".png");
+}
+
+/**
+ * Draws the \a pixmap at \a pos, extending its edges outwards by the tile
+ * padding.
+ */
+void drawPaddedTile(QPainter &painter, const QPixmap &pixmap,
+                    const QPoint &pos)
+{
+    const int w = pixmap.width();
+    const int h = pixmap.height();
+    const int x = pos.x();
+    const int y = pos.y();
+    const int p = TilePadding;
+
+    painter.drawPixmap(pos, pixmap);
+
+    // Edges
+    painter.drawPixmap(QRect(x - p, y, p, h), pixmap, QRect(0, 0, 1, h));
+    painter.drawPixmap(QRect(x + w, y, p, h), pixmap, QRect(w - 1, 0, 1, h));
+    painter.drawPixmap(QRect(x, y - p, w, p), pixmap, QRect(0, 0, w, 1));
+    painter.drawPixmap(QRect(x, y + h, w, p), pixmap, QRect(0, h - 1, w, 1));
+
+    // Corners
+    painter.drawPixmap(QRect(x - p, y - p, p, p), pixmap,
+                       QRect(0, 0, 1, 1));
+    painter.drawPixmap(QRect(x + w, y - p, p, p), pixmap,
+                       QRect(w - 1, 0, 1, 1));
+    painter.drawPixmap(QRect(x - p, y + h, p, p), pixmap,
+                       QRect(0, h - 1, 1, 1));
+    painter.drawPixmap(QRect(x + w, y + h, p, p), pixmap,
+                       QRect(w - 1, h - 1, 1, 1));
+}
+
+QPoint toPixelCoordinates(const Map *map, qreal x, qreal y)
+{
+    // Isometric needs special handling, since the pixel values are based
+    // solely on the tile height.
+    const int multiplierX = map->orientation() == Map::Isometric ?
+                map->tileHeight() : map->tileWidth();
+    const int multiplierY = map->tileHeight();
+
+    return QPoint(qRound(x * multiplierX), qRound(y * multiplierY));
+}
+
+} // anonymous namespace
+
+BakePlugin::BakePlugin()
+    : mGidSize(4)
+{
+}
+
+bool BakePlugin::write(const Map *map, const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    const QString baseName = fileInfo.completeBaseName();
+    mMapDir = fileInfo.path();
+
+    collectTiles(map);
+
+    if (!writeAtlases(baseName))
+        return false;
+
+    const QString dataFileName = baseName + QLatin1String(".bin");
+    if (!writeLayerData(map, mMapDir.filePath(dataFileName)))
+        return false;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        mError = tr("Could not open file for writing.");
+        return false;
+    }
+
+    LuaTableWriter writer(&file);
+    writer.writeStartDocument();
+    writeMap(writer, map, baseName);
+    writer.writeEndDocument();
+
+    return !writer.hasError();
+}
+
+QString BakePlugin::nameFilter() const
+{
+    return tr("Baked Lua files with tile atlas (*.lua)");
+}
+
+QString BakePlugin::errorString() const
+{
+    return mError;
+}
+
+/**
+ * Collects the tiles used by the tile layers and tile objects of the map.
+ */
+void BakePlugin::collectTiles(const Map *map)
+{
+    mTiles.clear();
+    mBakedIds.clear();
+
+    foreach (Layer *layer, map->layers()) {
+        if (TileLayer *tileLayer = layer->asTileLayer()) {
+            for (int y = 0; y < tileLayer->height(); ++y)
+                for (int x = 0; x < tileLayer->width(); ++x)
+                    addTile(tileLayer->cellAt(x, y).tile);
+        } else if (ObjectGroup *objectGroup = layer->asObjectGroup()) {
+            foreach (MapObject *mapObject, objectGroup->objects())
+                addTile(mapObject->tile());
+        }
+    }
+}
+
+void BakePlugin::addTile(Tile *tile)
+{
+    if (!tile || mBakedIds.contains(tile))
+        return;
+
+    mTiles.append(tile);
+    mBakedIds.insert(tile, mTiles.size());
+}
+
+bool BakePlugin::writeAtlases(const QString &baseName)
+{
+    QList<QSize> sizes;
+    foreach (const Tile *tile, mTiles)
+        sizes.append(tile->image().size());
+
+    AtlasPacker packer(MaximumAtlasSize, TilePadding);
+    if (!packer.pack(sizes)) {
+        mError = tr("A tile does not fit on an atlas of %1x%1 pixels.")
+                .arg(MaximumAtlasSize);
+        return false;
+    }
+
+    mTilePages.clear();
+    mTilePositions.clear();
+    mPageSizes.clear();
+
+    for (int i = 0; i < mTiles.size(); ++i) {
+        mTilePages.append(packer.page(i));
+        mTilePositions.append(packer.position(i));
+    }
+
+    for (int page = 0; page < packer.pageCount(); ++page) {
+        QImage image(packer.pageSize(page), QImage::Format_ARGB32);
+        image.fill(0);
+
+        QPainter painter(&image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (int i = 0; i < mTiles.size(); ++i) {
+            if (mTilePages.at(i) == page)
+                drawPaddedTile(painter, mTiles.at(i)->image(),
+                               mTilePositions.at(i));
+        }
+        painter.end();
+
+        const QString fileName = atlasFileName(baseName, page);
+        if (!image.save(mMapDir.filePath(fileName), "PNG")) {
+            mError = tr("Could not write atlas image %1.").arg(fileName);
+            return false;
+        }
+
+        mPageSizes.append(image.size());
+    }
+
+    return true;
+}
+
+/**
+ * Writes the baked tile IDs of all tile layers to the file at \a fileName,
+ * remembering the offset of each layer.
+ */
+bool BakePlugin::writeLayerData(const Map *map, const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        mError = tr("Could not open file %1 for writing.")
+                .arg(QFileInfo(fileName).fileName());
+        return false;
+    }
+
+    // Leave 4 bits for the flip and rotation flags
+    mGidSize = mTiles.size() < (1 << 12) ? 2 : 4;
+    mLayerOffsets.clear();
+
+    foreach (Layer *layer, map->layers()) {
+        const TileLayer *tileLayer = layer->asTileLayer();
+        if (!tileLayer)
+            continue;
+
+        QByteArray data(tileLayer->width() * tileLayer->height() * mGidSize,
+                        '\0');
+        uchar *out = reinterpret_cast<uchar*>(data.data());
+
+        for (int y = 0; y < tileLayer->height(); ++y) {
+            for (int x = 0; x < tileLayer->width(); ++x) {
+                const uint gid = bakedGid(tileLayer->cellAt(x, y));
+                if (mGidSize == 2)
+                    qToLittleEndian<quint16>(gid, out);
+                else
+                    qToLittleEndian<quint32>(gid, out);
+                out += mGidSize;
+            }
+        }
+
+        mLayerOffsets.append(file.pos());
+        if (file.write(data) != data.size()) {
+            mError = file.errorString();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint BakePlugin::bakedGid(const Cell &cell) const
+{
+    if (cell.isEmpty())
+        return 0;
+
+    uint flags = cell.ang & 3;
+    if (cell.flippedHorizontally)
+        flags |= 8;
+    if (cell.flippedVertically)
+        flags |= 4;
+
+    return mBakedIds.value(cell.tile) | (flags << (mGidSize * 8 - 4));
+}
+
+void BakePlugin::writeMap(LuaTableWriter &writer, const Map *map,
+                          const QString &baseName)
+{
+    writer.writeStartReturnTable();
+
+    writer.writeKeyAndValue("version", "1.1");
+    writer.writeKeyAndValue("luaversion", "5.1");
+
+    const char *orientation = "unknown";
+    switch (map->orientation()) {
+    case Map::Unknown:
+        break;
+    case Map::Orthogonal:
+        orientation = "orthogonal";
+        break;
+    case Map::Isometric:
+        orientation = "isometric";
+        break;
+    case Map::Hexagonal:
+        orientation = "hexagonal";
+        break;
+    }
+
+    writer.writeKeyAndValue("orientation", orientation);
+    writer.writeKeyAndValue("width", map->width());
+    writer.writeKeyAndValue("height", map->height());
+    writer.writeKeyAndValue("tilewidth", map->tileWidth());
+    writer.writeKeyAndValue("tileheight", map->tileHeight());
+
+    writeProperties(writer, map->properties());
+
+    writer.writeStartTable("atlases");
+    for (int page = 0; page < mPageSizes.size(); ++page) {
+        writer.writeStartTable();
+        writer.setSuppressNewlines(true);
+        writer.writeKeyAndValue("image", atlasFileName(baseName, page));
+        writer.writeKeyAndValue("width", mPageSizes.at(page).width());
+        writer.writeKeyAndValue("height", mPageSizes.at(page).height());
+        writer.writeEndTable();
+        writer.setSuppressNewlines(false);
+    }
+    writer.writeEndTable();
+
+    // The tiles are indexed by their baked ID
+    writer.writeStartTable("tiles");
+    for (int i = 0; i < mTiles.size(); ++i) {
+        const Tile *tile = mTiles.at(i);
+        const Properties &properties = tile->properties();
+
+        writer.writeStartTable();
+        writer.setSuppressNewlines(properties.isEmpty());
+        writer.writeKeyAndValue("atlas", mTilePages.at(i) + 1);
+        writer.writeKeyAndValue("x", mTilePositions.at(i).x());
+        writer.writeKeyAndValue("y", mTilePositions.at(i).y());
+        writer.writeKeyAndValue("width", tile->width());
+        writer.writeKeyAndValue("height", tile->height());
+        if (!properties.isEmpty())
+            writeProperties(writer, properties);
+        writer.writeEndTable();
+        writer.setSuppressNewlines(false);
+    }
+    writer.writeEndTable();
+
+    writer.writeKeyAndValue("data", baseName + QLatin1String(".bin"));
+    writer.writeKeyAndValue("gidsize", mGidSize);
+
+    writer.writeStartTable("layers");
+    int tileLayerIndex = 0;
+    foreach (Layer *layer, map->layers()) {
+        if (TileLayer *tileLayer = layer->asTileLayer()) {
+            writeTileLayer(writer, tileLayer,
+                           mLayerOffsets.at(tileLayerIndex++));
+        } else if (ObjectGroup *objectGroup = layer->asObjectGroup()) {
+            writeObjectGroup(writer, objectGroup);
+        }
+    }
+    writer.writeEndTable();
+
+    writer.writeEndTable();
+}
+
+void BakePlugin::writeProperties(LuaTableWriter &writer,
+                                 const Properties &properties)
+{
+    writer.writeStartTable("properties");
+
+    Properties::const_iterator it = properties.constBegin();
+    Properties::const_iterator it_end = properties.constEnd();
+    for (; it != it_end; ++it)
+        writer.writeQuotedKeyAndValue(it.key(), it.value());
+
+    writer.writeEndTable();
+}
+
+void BakePlugin::writeTileLayer(LuaTableWriter &writer,
+                                const TileLayer *tileLayer,
+                                qint64 offset)
+{
+    writer.writeStartTable();
+
+    writer.writeKeyAndValue("type", "tilelayer");
+    writer.writeKeyAndValue("name", tileLayer->name());
+    writer.writeKeyAndValue("x", tileLayer->x());
+    writer.writeKeyAndValue("y", tileLayer->y());
+    writer.writeKeyAndValue("width", tileLayer->width());
+    writer.writeKeyAndValue("height", tileLayer->height());
+    writer.writeKeyAndValue("visible", tileLayer->isVisible());
+    writer.writeKeyAndValue("opacity", tileLayer->opacity());
+    writeProperties(writer, tileLayer->properties());
+
+    writer.writeKeyAndValue("encoding", "binary");
+    writer.writeKeyAndUnquotedValue("offset", QByteArray::number(offset));
+
+    writer.writeEndTable();
+}
+
+void BakePlugin::writeObjectGroup(LuaTableWriter &writer,
+                                  const ObjectGroup *objectGroup)
+{
+    writer.writeStartTable();
+    writer.writeKeyAndValue("type", "objectgroup");
+    writer.writeKeyAndValue("name", objectGroup->name());
+    writer.writeKeyAndValue("visible", objectGroup->isVisible());
+    writer.writeKeyAndValue("opacity", objectGroup->opacity());
+    writeProperties(writer, objectGroup->properties());
+
+    writer.writeStartTable("objects");
+    foreach (MapObject *mapObject, objectGroup->objects())
+        writeMapObject(writer, mapObject);
+    writer.writeEndTable();
+
+    writer.writeEndTable();
+}
+
+void BakePlugin::writeMapObject(LuaTableWriter &writer,
+                                const MapObject *mapObject)
+{
+    writer.writeStartTable();
+    writer.writeKeyAndValue("name", mapObject->name());
+    writer.writeKeyAndValue("type", mapObject->type());
+
+    const Map *map = mapObject->objectGroup()->map();
+    const QPoint pos = toPixelCoordinates(map, mapObject->x(),
+                                          mapObject->y());
+    const QPoint size = toPixelCoordinates(map, mapObject->width(),
+                                           mapObject->height());
+
+    writer.writeKeyAndValue("x", pos.x());
+    writer.writeKeyAndValue("y", pos.y());
+    writer.writeKeyAndValue("width", size.x());
+    writer.writeKeyAndValue("height", size.y());
+
+    if (mapObject->tile())
+        writer.writeKeyAndValue("gid", bakedGid(mapObject->getCell()));
+
+    const QPolygonF &polygon = mapObject->polygon();
+    if (!polygon.isEmpty()) {
+        if (mapObject->shape() == MapObject::Polygon)
+            writer.writeStartTable("polygon");
+        else
+            writer.writeStartTable("polyline");
+
+        // Written as pairs of pixel coordinates: { { 1, 1 }, { 2, 2 }, ... }
+        foreach (const QPointF &point, polygon) {
+            writer.writeStartTable();
+            writer.setSuppressNewlines(true);
+
+            const QPoint pixel = toPixelCoordinates(map, point.x(), point.y());
+            writer.writeValue(pixel.x());
+            writer.writeValue(pixel.y());
+
+            writer.writeEndTable();
+            writer.setSuppressNewlines(false);
+        }
+
+        writer.writeEndTable();
+    }
+
+    writeProperties(writer, mapObject->properties());
+
+    writer.writeEndTable();
+}
+
+Q_EXPORT_PLUGIN2(Bake, BakePlugin)
@@ -0,0 +1,112 @@
+/*
+ * Baked Lua Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BAKEPLUGIN_H
+#define BAKEPLUGIN_H
+
+#include "bake_global.h"
+
+#include "mapwriterinterface.h"
+
+#include <QDir>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPoint>
+#include <QSize>
+
+namespace Tiled {
+class Cell;
+class MapObject;
+class ObjectGroup;
+class Properties;
+class Tile;
+class TileLayer;
+}
+
+namespace Lua {
+class LuaTableWriter;
+}
+
+namespace Bake {
+
+/**
+ * This plugin exports maps in a form that is ready to be loaded by a game
+ * engine. Only the tiles that are actually used by the map are written,
+ * packed into one or more power-of-two atlas images. The tiles are
+ * renumbered in the order in which they are packed.
+ *
+ * Exporting "level.lua" writes the following files:
+ *
+ *  - level.lua: A Lua table describing the map, the atlases and the location
+ *    of each tile on them, and the layers.
+ *  - level_1.png, level_2.png, ...: The atlas images.
+ *  - level.bin: The data of all tile layers as little-endian tile IDs, at
+ *    the offsets given by the layers. When fewer than 4096 tiles are used,
+ *    the IDs are 16-bit, with the flip and rotation flags in the highest 4
+ *    bits. Otherwise they are 32-bit with the same flags as TMX files.
+ */
+class BAKESHARED_EXPORT BakePlugin : public QObject,
+                                     public Tiled::MapWriterInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(Tiled::MapWriterInterface)
+
+public:
+    BakePlugin();
+
+    // MapWriterInterface
+    bool write(const Tiled::Map *map, const QString &fileName);
+    QString nameFilter() const;
+    QString errorString() const;
+
+private:
+    void collectTiles(const Tiled::Map *map);
+    void addTile(Tiled::Tile *tile);
+    bool writeAtlases(const QString &baseName);
+    bool writeLayerData(const Tiled::Map *map, const QString &fileName);
+    uint bakedGid(const Tiled::Cell &cell) const;
+
+    void writeMap(Lua::LuaTableWriter &, const Tiled::Map *,
+                  const QString &baseName);
+    void writeProperties(Lua::LuaTableWriter &, const Tiled::Properties &);
+    void writeTileLayer(Lua::LuaTableWriter &, const Tiled::TileLayer *,
+                        qint64 offset);
+    void writeObjectGroup(Lua::LuaTableWriter &, const Tiled::ObjectGroup *);
+    void writeMapObject(Lua::LuaTableWriter &, const Tiled::MapObject *);
+
+    QString mError;
+    QDir mMapDir;     // The directory in which the map is being saved
+
+    // The used tiles in the order of their baked IDs, starting at 1
+    QList<Tiled::Tile*> mTiles;
+    QHash<const Tiled::Tile*, uint> mBakedIds;
+
+    // Where each of the used tiles ended up
+    QList<int> mTilePages;
+    QList<QPoint> mTilePositions;
+    QList<QSize> mPageSizes;
+
+    int mGidSize;
+    QList<qint64> mLayerOffsets;
+};
+
+} // namespace Bake
+
+#endif // BAKEPLUGIN_H
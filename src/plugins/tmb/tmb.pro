@@ -0,0 +1,7 @@
+include(../plugin.pri)
+
+DEFINES += TMB_LIBRARY
+
+SOURCES += tmbplugin.cpp
+HEADERS += tmbplugin.h\
+        tmb_global.h
@@ -0,0 +1,70 @@
+/*
+ * Binary Map Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tmbplugin.h"
+
+#include "binarymap.h"
+
+#include <QFileInfo>
+
+using namespace Tmb;
+
+TmbPlugin::TmbPlugin()
+{
+}
+
+// Reader
+Tiled::Map *TmbPlugin::read(const QString &fileName)
+{
+    Tiled::BinaryMapReader reader;
+    Tiled::Map *map = reader.readMap(fileName);
+    if (!map)
+        mError = reader.errorString();
+
+    return map;
+}
+
+bool TmbPlugin::supportsFile(const QString &fileName) const
+{
+    return QFileInfo(fileName).suffix() == QLatin1String("tmb");
+}
+
+// Writer
+bool TmbPlugin::write(const Tiled::Map *map, const QString &fileName)
+{
+    Tiled::BinaryMapWriter writer;
+    if (!writer.writeMap(map, fileName)) {
+        mError = writer.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+QString TmbPlugin::nameFilter() const
+{
+    return tr("Tiled binary map files (*.tmb)");
+}
+
+QString TmbPlugin::errorString() const
+{
+    return mError;
+}
+
+Q_EXPORT_PLUGIN2(Tmb, TmbPlugin)
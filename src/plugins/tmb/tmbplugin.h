@@ -0,0 +1,63 @@
+/*
+ * Binary Map Tiled Plugin
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TMBPLUGIN_H
+#define TMBPLUGIN_H
+
+#include "tmb_global.h"
+
+#include "mapwriterinterface.h"
+#include "mapreaderinterface.h"
+
+#include <QObject>
+
+namespace Tmb {
+
+/**
+ * Reads and writes maps in the binary map format, which can be loaded
+ * without parsing the tile layer data. See Tiled::BinaryMapReader.
+ */
+class TMBSHARED_EXPORT TmbPlugin :
+        public QObject,
+        public Tiled::MapWriterInterface,
+        public Tiled::MapReaderInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(Tiled::MapReaderInterface)
+    Q_INTERFACES(Tiled::MapWriterInterface)
+
+public:
+    TmbPlugin();
+
+    // MapReaderInterface
+    Tiled::Map *read(const QString &fileName);
+    bool supportsFile(const QString &fileName) const;
+
+    // MapWriterInterface
+    bool write(const Tiled::Map *map, const QString &fileName);
+    QString nameFilter() const;
+    QString errorString() const;
+
+private:
+    QString mError;
+};
+
+} // namespace Tmb
+
+#endif // TMBPLUGIN_H
@@ -21,11 +21,14 @@
 #include "tmwplugin.h"
 
 #include "map.h"
+#include "solidrectangles.h"
 #include "tile.h"
 #include "tilelayer.h"
 
 #include <QDataStream>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 
 using namespace Tmw;
 
@@ -57,6 +60,32 @@ bool TmwPlugin::write(const Tiled::Map *map, const QString &fileName)
         return false;
     }
 
+    // The suffix determines the format, so that a .wlk file always holds
+    // the collision grid
+    const QFileInfo fileInfo(fileName);
+    if (fileInfo.suffix().compare(QLatin1String("rct"),
+                                  Qt::CaseInsensitive) == 0) {
+        return writeCollisionRectangles(collisionLayer, fileName);
+    }
+
+    if (!writeCollisionGrid(collisionLayer, fileName))
+        return false;
+
+    const QString mode = map->property(QLatin1String("collision"));
+    if (mode == QLatin1String("rectangles") || mode == QLatin1String("both")) {
+        const QString rectanglesFileName = fileInfo.dir().filePath(
+                    fileInfo.completeBaseName() + QLatin1String(".rct"));
+
+        if (!writeCollisionRectangles(collisionLayer, rectanglesFileName))
+            return false;
+    }
+
+    return true;
+}
+
+bool TmwPlugin::writeCollisionGrid(const Tiled::TileLayer *collisionLayer,
+                                   const QString &fileName)
+{
     QFile file(fileName);
     if (!file.open(QIODevice::WriteOnly)) {
         mError = tr("Could not open file for writing.");
@@ -73,18 +102,53 @@ bool TmwPlugin::write(const Tiled::Map *map, const QString &fileName)
     stream << (qint16) height;
 
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            Tile *tile = collisionLayer->cellAt(x, y).tile;
-            stream << (qint8) (tile && tile->id() > 0);
-        }
+        for (int x = 0; x < width; ++x)
+            stream << (qint8) isCollision(collisionLayer->cellAt(x, y));
     }
 
     return true;
 }
 
+bool TmwPlugin::writeCollisionRectangles(
+        const Tiled::TileLayer *collisionLayer,
+        const QString &fileName)
+{
+    using namespace Tiled;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        mError = tr("Could not open file for writing.");
+        return false;
+    }
+
+    const QVector<QRect> rectangles = solidRectangles(collisionLayer,
+                                                      isCollision);
+
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    stream << (qint16) collisionLayer->width();
+    stream << (qint16) collisionLayer->height();
+    stream << (qint32) rectangles.size();
+
+    foreach (const QRect &rect, rectangles) {
+        stream << (qint16) rect.x();
+        stream << (qint16) rect.y();
+        stream << (qint16) rect.width();
+        stream << (qint16) rect.height();
+    }
+
+    return true;
+}
+
+bool TmwPlugin::isCollision(const Tiled::Cell &cell)
+{
+    return cell.tile && cell.tile->id() > 0;
+}
+
 QString TmwPlugin::nameFilter() const
 {
-    return tr("TMW-eAthena collision files (*.wlk)");
+    return tr("TMW-eAthena collision files (*.wlk *.rct)");
 }
 
 QString TmwPlugin::errorString() const
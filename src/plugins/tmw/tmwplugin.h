@@ -27,8 +27,23 @@
 
 #include <QObject>
 
+namespace Tiled {
+class Cell;
+class TileLayer;
+}
+
 namespace Tmw {
 
+/**
+ * Exports the layer called "collision" as a TMW-eAthena collision file,
+ * with one byte per cell.
+ *
+ * Files with the suffix ".rct" instead get the solid cells merged into
+ * rectangles, written as two 16-bit sizes, a 32-bit rectangle count and four
+ * 16-bit values (x, y, width and height) per rectangle. When the map has a
+ * "collision" property set to "rectangles" or "both", such a file is also
+ * written next to the collision file.
+ */
 class TMWSHARED_EXPORT TmwPlugin : public QObject,
                                    public Tiled::MapWriterInterface
 {
@@ -44,6 +59,13 @@ public:
     QString errorString() const;
 
 private:
+    bool writeCollisionGrid(const Tiled::TileLayer *collisionLayer,
+                            const QString &fileName);
+    bool writeCollisionRectangles(const Tiled::TileLayer *collisionLayer,
+                                  const QString &fileName);
+
+    static bool isCollision(const Tiled::Cell &cell);
+
     QString mError;
 };
 
@@ -20,6 +20,10 @@
 
 #include "changeproperties.h"
 
+#include "documentmanager.h"
+#include "tile.h"
+#include "tileset.h"
+
 #include <QCoreApplication>
 
 using namespace Tiled;
@@ -47,6 +51,10 @@ void ChangeProperties::undo()
 
 void ChangeProperties::swapProperties()
 {
+    // Tilesets may be read by a save in the background
+    if (dynamic_cast<Tile*>(mObject) || dynamic_cast<Tileset*>(mObject))
+        DocumentManager::instance()->waitForBackgroundSaves();
+
     const Properties oldProperties = mObject->properties();
     mObject->setProperties(mNewProperties);
     mNewProperties = oldProperties;
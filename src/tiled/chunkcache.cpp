@@ -0,0 +1,112 @@
+/*
+ * chunkcache.cpp
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkcache.h"
+
+#include <QList>
+
+using namespace Tiled::Internal;
+
+namespace {
+
+// The number of chunks kept at least, when only few are visible
+const int MinimumCachedChunks = 16;
+
+// The number of chunks kept at most. With chunks of 512x512 pixels this
+// amounts to 256 MB.
+const int MaximumCachedChunks = 256;
+
+} // anonymous namespace
+
+ChunkCache *ChunkCache::mInstance = 0;
+
+ChunkCache *ChunkCache::instance()
+{
+    if (!mInstance)
+        mInstance = new ChunkCache;
+
+    return mInstance;
+}
+
+void ChunkCache::deleteInstance()
+{
+    delete mInstance;
+    mInstance = 0;
+}
+
+ChunkCache::ChunkCache()
+    : mTotalVisibleChunks(0)
+{
+    mChunks.setMaxCost(MinimumCachedChunks);
+}
+
+QPixmap *ChunkCache::object(const void *owner, const ChunkIndex &index) const
+{
+    return mChunks.object(Key(owner, index));
+}
+
+bool ChunkCache::contains(const void *owner, const ChunkIndex &index) const
+{
+    return mChunks.contains(Key(owner, index));
+}
+
+void ChunkCache::insert(const void *owner, const ChunkIndex &index,
+                        QPixmap *pixmap)
+{
+    mChunks.insert(Key(owner, index), pixmap);
+}
+
+void ChunkCache::remove(const void *owner, const ChunkIndex &index)
+{
+    mChunks.remove(Key(owner, index));
+}
+
+void ChunkCache::clear(const void *owner)
+{
+    foreach (const Key &key, mChunks.keys())
+        if (key.first == owner)
+            mChunks.remove(key);
+
+    setVisibleChunks(owner, 0);
+}
+
+void ChunkCache::setVisibleChunks(const void *owner, int count)
+{
+    const int previous = mVisibleChunks.value(owner);
+    if (count == previous)
+        return;
+
+    if (count > 0)
+        mVisibleChunks.insert(owner, count);
+    else
+        mVisibleChunks.remove(owner);
+
+    mTotalVisibleChunks += count - previous;
+    updateMaxCost();
+}
+
+void ChunkCache::updateMaxCost()
+{
+    // Twice the visible chunks, so that scrolling doesn't immediately evict
+    // the chunks that were just rendered
+    const int maxCost = qBound(MinimumCachedChunks,
+                               mTotalVisibleChunks * 2,
+                               MaximumCachedChunks);
+    mChunks.setMaxCost(maxCost);
+}
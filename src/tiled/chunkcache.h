@@ -0,0 +1,94 @@
+/*
+ * chunkcache.h
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QPair>
+#include <QPixmap>
+
+namespace Tiled {
+namespace Internal {
+
+/**
+ * Keeps the pre-rendered chunks of the items displaying tile layers. The
+ * chunks of all items share a single budget, so that the memory used by
+ * them is bounded no matter how many layers or maps are open.
+ *
+ * Each item tells the cache how many chunks it needs to cover the view.
+ * The budget follows the total of these, so that the visible chunks don't
+ * evict each other, and it shrinks again along with the view. It never
+ * exceeds a fixed maximum.
+ */
+class ChunkCache
+{
+public:
+    typedef QPair<int, int> ChunkIndex;
+
+    static ChunkCache *instance();
+    static void deleteInstance();
+
+    /**
+     * Returns the chunk of \a owner at \a index, or 0 when it isn't
+     * cached. The pointer may be invalidated by the next insert().
+     */
+    QPixmap *object(const void *owner, const ChunkIndex &index) const;
+
+    bool contains(const void *owner, const ChunkIndex &index) const;
+
+    /**
+     * Inserts the chunk of \a owner at \a index. The cache takes
+     * ownership of the \a pixmap.
+     */
+    void insert(const void *owner, const ChunkIndex &index, QPixmap *pixmap);
+
+    void remove(const void *owner, const ChunkIndex &index);
+
+    /**
+     * Removes all chunks of \a owner and forgets the number of chunks it
+     * needs. Should be called when the owner is deleted.
+     */
+    void clear(const void *owner);
+
+    /**
+     * Sets the number of chunks \a owner needs to cover the view, and
+     * adjusts the budget accordingly.
+     */
+    void setVisibleChunks(const void *owner, int count);
+
+private:
+    ChunkCache();
+
+    typedef QPair<const void*, ChunkIndex> Key;
+
+    void updateMaxCost();
+
+    QCache<Key, QPixmap> mChunks;
+    QHash<const void*, int> mVisibleChunks;
+    int mTotalVisibleChunks;
+
+    static ChunkCache *mInstance;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // CHUNKCACHE_H
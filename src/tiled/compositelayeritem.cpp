@@ -0,0 +1,316 @@
+/*
+ * compositelayeritem.cpp
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compositelayeritem.h"
+
+#include "chunkcache.h"
+#include "maprenderer.h"
+#include "occlusionculler.h"
+#include "tilelayer.h"
+#include "tilelayerpyramid.h"
+
+#include <QStyleOptionGraphicsItem>
+#include <QTime>
+#include <QTimer>
+#include <QWidget>
+
+#include <cmath>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+namespace {
+
+// The size of the cached chunks in device pixels
+const int ChunkSize = 512;
+
+// The time spent rendering chunks before returning to the event loop
+const int RenderTimeSlice = 15;
+
+} // anonymous namespace
+
+CompositeLayerItem::CompositeLayerItem(const QList<TileLayer*> &layers,
+                                       MapRenderer *renderer,
+                                       const OcclusionCuller *culler)
+    : mLayers(layers)
+    , mRenderer(renderer)
+    , mCuller(culler)
+    , mChunkScale(0)
+    , mRenderScheduled(false)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+
+    foreach (const TileLayer *layer, mLayers)
+        mPyramids.append(new TileLayerPyramid(layer, this));
+
+    syncWithTileLayers();
+}
+
+CompositeLayerItem::~CompositeLayerItem()
+{
+    ChunkCache::instance()->clear(this);
+    qDeleteAll(mPyramids);
+}
+
+void CompositeLayerItem::syncWithTileLayers()
+{
+    prepareGeometryChange();
+
+    mBoundingRect = QRectF();
+    foreach (const TileLayer *layer, mLayers)
+        mBoundingRect |= mRenderer->boundingRect(layer->bounds());
+
+    invalidateCache();
+}
+
+bool CompositeLayerItem::layersChanged() const
+{
+    for (int i = 0; i < mLayers.size(); ++i)
+        if (mLayers.at(i)->generation() != mGenerations.at(i))
+            return true;
+    return false;
+}
+
+void CompositeLayerItem::invalidateCache()
+{
+    ChunkCache::instance()->clear(this);
+    mPendingChunks.clear();
+    foreach (TileLayerPyramid *pyramid, mPyramids)
+        pyramid->invalidate();
+    updateGenerations();
+}
+
+void CompositeLayerItem::invalidateCache(const QRectF &rect)
+{
+    for (int i = 0; i < mLayers.size(); ++i)
+        if (mLayers.at(i)->generation() != mGenerations.at(i))
+            mPyramids.at(i)->invalidate(rect);
+
+    updateGenerations();
+
+    ChunkCache *cache = ChunkCache::instance();
+    const QRect chunks = chunksIntersecting(rect);
+    for (int y = chunks.top(); y <= chunks.bottom(); ++y)
+        for (int x = chunks.left(); x <= chunks.right(); ++x)
+            cache->remove(this, ChunkIndex(x, y));
+}
+
+QRectF CompositeLayerItem::boundingRect() const
+{
+    return mBoundingRect;
+}
+
+void CompositeLayerItem::paint(QPainter *painter,
+                               const QStyleOptionGraphicsItem *option,
+                               QWidget *widget)
+{
+    // The chunks can only be blitted as-is when the view is not rotated,
+    // sheared or stretched
+    const QTransform &transform = painter->worldTransform();
+    if (transform.type() > QTransform::TxScale
+            || transform.m11() != transform.m22()
+            || transform.m11() <= 0) {
+        drawLayers(painter, option->exposedRect);
+        return;
+    }
+
+    if (layersChanged())
+        invalidateCache();
+
+    ChunkCache *cache = ChunkCache::instance();
+
+    // The layers all belong to the same map, so they use their pyramids at
+    // the same scale
+    const qreal scale = transform.m11();
+    if (mPyramids.first()->isUsedAt(scale)) {
+        if (mChunkScale != 0) {
+            cache->clear(this);
+            mPendingChunks.clear();
+            mChunkScale = 0;
+        }
+        drawPyramids(painter, option->exposedRect, scale);
+        return;
+    }
+
+    if (scale != mChunkScale) {
+        cache->clear(this);
+        mPendingChunks.clear();
+        mChunkScale = scale;
+    }
+    mRenderHints = painter->renderHints();
+
+    const QRectF rect = option->exposedRect & mBoundingRect;
+    const QRect chunks = chunksIntersecting(rect);
+    if (chunks.isEmpty())
+        return;
+
+    // Make sure the chunks covering the view don't evict each other
+    if (widget) {
+        const QRectF viewRect =
+                transform.inverted().mapRect(QRectF(widget->rect()));
+        const QRect viewChunks = chunksIntersecting(viewRect & mBoundingRect);
+        cache->setVisibleChunks(this, viewChunks.width() * viewChunks.height());
+    }
+
+    const QRectF source(0, 0, ChunkSize, ChunkSize);
+
+    for (int y = chunks.top(); y <= chunks.bottom(); ++y) {
+        for (int x = chunks.left(); x <= chunks.right(); ++x) {
+            const ChunkIndex index(x, y);
+            const QRectF target = chunkRect(index);
+
+            if (const QPixmap *pixmap = cache->object(this, index)) {
+                painter->drawPixmap(target, *pixmap, source);
+            } else {
+                painter->save();
+                painter->setClipRect(target, Qt::IntersectClip);
+                drawLayers(painter, target & rect);
+                painter->restore();
+
+                requestChunk(index);
+            }
+        }
+    }
+}
+
+/**
+ * Renders the requested chunks until the time slice runs out, continuing
+ * later when there are more.
+ */
+void CompositeLayerItem::renderPendingChunks()
+{
+    mRenderScheduled = false;
+
+    if (mChunkScale <= 0)
+        return;
+
+    QTime time;
+    time.start();
+
+    ChunkCache *cache = ChunkCache::instance();
+
+    while (!mPendingChunks.isEmpty() && time.elapsed() < RenderTimeSlice) {
+        const ChunkIndex index = mPendingChunks.takeFirst();
+        if (cache->contains(this, index))
+            continue;
+
+        const QRectF rect = chunkRect(index);
+
+        QPixmap *pixmap = new QPixmap(ChunkSize, ChunkSize);
+        pixmap->fill(Qt::transparent);
+
+        QPainter painter(pixmap);
+        painter.setRenderHints(mRenderHints);
+        painter.scale(mChunkScale, mChunkScale);
+        painter.translate(-rect.topLeft());
+        drawLayers(&painter, rect);
+        painter.end();
+
+        cache->insert(this, index, pixmap);
+    }
+
+    if (!mPendingChunks.isEmpty()) {
+        mRenderScheduled = true;
+        QTimer::singleShot(0, this, SLOT(renderPendingChunks()));
+    }
+}
+
+/**
+ * Draws the visible layers directly, each with its own opacity.
+ */
+void CompositeLayerItem::drawLayers(QPainter *painter,
+                                    const QRectF &exposed) const
+{
+    const qreal opacity = painter->opacity();
+
+    foreach (const TileLayer *layer, mLayers) {
+        if (!layer->isVisible())
+            continue;
+
+        painter->save();
+        painter->setOpacity(opacity * layer->opacity());
+        mRenderer->drawTileLayer(painter, layer, exposed,
+                                 mCuller ? mCuller->coveredCells(layer) : 0);
+        painter->restore();
+    }
+}
+
+/**
+ * Draws the visible layers from their pyramids, each with its own opacity.
+ * Covered cells are not culled there, since the tiles are tiny anyway.
+ */
+void CompositeLayerItem::drawPyramids(QPainter *painter,
+                                      const QRectF &exposed, qreal scale)
+{
+    const qreal opacity = painter->opacity();
+
+    for (int i = 0; i < mLayers.size(); ++i) {
+        const TileLayer *layer = mLayers.at(i);
+        if (!layer->isVisible())
+            continue;
+
+        painter->setOpacity(opacity * layer->opacity());
+        mPyramids.at(i)->draw(painter, exposed, scale);
+    }
+
+    painter->setOpacity(opacity);
+}
+
+/**
+ * Returns the range of chunks intersecting the given \a rect at the current
+ * scale.
+ */
+QRect CompositeLayerItem::chunksIntersecting(const QRectF &rect) const
+{
+    if (rect.isEmpty() || mChunkScale <= 0)
+        return QRect();
+
+    const qreal chunkSize = ChunkSize / mChunkScale;
+    const int left = (int) std::floor(rect.left() / chunkSize);
+    const int top = (int) std::floor(rect.top() / chunkSize);
+    const int right = (int) std::floor(rect.right() / chunkSize);
+    const int bottom = (int) std::floor(rect.bottom() / chunkSize);
+
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QRectF CompositeLayerItem::chunkRect(const ChunkIndex &index) const
+{
+    const qreal chunkSize = ChunkSize / mChunkScale;
+    return QRectF(index.first * chunkSize, index.second * chunkSize,
+                  chunkSize, chunkSize);
+}
+
+void CompositeLayerItem::requestChunk(const ChunkIndex &index)
+{
+    if (!mPendingChunks.contains(index))
+        mPendingChunks.append(index);
+
+    if (!mRenderScheduled) {
+        mRenderScheduled = true;
+        QTimer::singleShot(0, this, SLOT(renderPendingChunks()));
+    }
+}
+
+void CompositeLayerItem::updateGenerations()
+{
+    mGenerations.resize(mLayers.size());
+    for (int i = 0; i < mLayers.size(); ++i)
+        mGenerations[i] = mLayers.at(i)->generation();
+}
@@ -0,0 +1,137 @@
+/*
+ * compositelayeritem.h
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPOSITELAYERITEM_H
+#define COMPOSITELAYERITEM_H
+
+#include <QGraphicsItem>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QPainter>
+#include <QPixmap>
+#include <QVector>
+
+namespace Tiled {
+
+class MapRenderer;
+class OcclusionCuller;
+class TileLayer;
+
+namespace Internal {
+
+class TileLayerPyramid;
+
+/**
+ * A graphics item displaying a number of adjacent tile layers flattened into
+ * a single cached image. The map scene uses it for the layers that are not
+ * being edited, so that painting doesn't need to composite each of them.
+ *
+ * The image is kept in chunks like in TileLayerItem. Chunks that are missing
+ * are drawn directly from the layers at first, and rendered into the cache
+ * from the event loop afterwards. When zoomed out far, the layers are drawn
+ * from their level-of-detail pyramids instead.
+ */
+class CompositeLayerItem : public QObject, public QGraphicsItem
+{
+    Q_OBJECT
+    Q_INTERFACES(QGraphicsItem)
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param layers   the tile layers to display, from bottom to top
+     * @param renderer the map renderer to use to render the layers
+     * @param culler   determines which cells are hidden by other layers, may
+     *                 be 0
+     */
+    CompositeLayerItem(const QList<TileLayer*> &layers,
+                       MapRenderer *renderer,
+                       const OcclusionCuller *culler = 0);
+    ~CompositeLayerItem();
+
+    /**
+     * Returns the tile layers displayed by this item.
+     */
+    const QList<TileLayer*> &layers() const { return mLayers; }
+
+    /**
+     * Updates the size of this item. Should be called when the size of the
+     * layers or the map has changed.
+     */
+    void syncWithTileLayers();
+
+    /**
+     * Returns whether any of the layers changed since the cache was last
+     * invalidated.
+     */
+    bool layersChanged() const;
+
+    /**
+     * Drops all cached chunks. Should be called when the look of the whole
+     * item may have changed, for example because one of its layers was
+     * hidden.
+     */
+    void invalidateCache();
+
+    /**
+     * Drops the cached chunks intersecting the given \a rect, in pixel
+     * coordinates. The pyramids are only updated for the layers that
+     * changed, since they don't depend on the covered cells.
+     */
+    void invalidateCache(const QRectF &rect);
+
+    // QGraphicsItem
+    QRectF boundingRect() const;
+    void paint(QPainter *painter,
+               const QStyleOptionGraphicsItem *option,
+               QWidget *widget = 0);
+
+private slots:
+    void renderPendingChunks();
+
+private:
+    typedef QPair<int, int> ChunkIndex;
+
+    void drawLayers(QPainter *painter, const QRectF &exposed) const;
+    void drawPyramids(QPainter *painter, const QRectF &exposed, qreal scale);
+    QRect chunksIntersecting(const QRectF &rect) const;
+    QRectF chunkRect(const ChunkIndex &index) const;
+    void requestChunk(const ChunkIndex &index);
+    void updateGenerations();
+
+    QList<TileLayer*> mLayers;
+    MapRenderer *mRenderer;
+    const OcclusionCuller *mCuller;
+    QRectF mBoundingRect;
+
+    QList<TileLayerPyramid*> mPyramids;
+
+    QList<ChunkIndex> mPendingChunks;
+    qreal mChunkScale;
+    QPainter::RenderHints mRenderHints;
+    QVector<uint> mGenerations;
+    bool mRenderScheduled;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // COMPOSITELAYERITEM_H
@@ -163,6 +163,9 @@ void DocumentManager::addDocument(MapDocument *mapDocument)
     mTabWidget->setTabToolTip(documentIndex, mapDocument->fileName());
     connect(mapDocument, SIGNAL(fileNameChanged()), SLOT(updateDocumentTab()));
     connect(mapDocument, SIGNAL(modifiedChanged()), SLOT(updateDocumentTab()));
+    connect(mapDocument, SIGNAL(saved()), SLOT(documentSaved()));
+    connect(mapDocument, SIGNAL(saveFailed(QString)),
+            SLOT(documentSaveFailed(QString)));
 
     switchToDocument(documentIndex);
 }
@@ -237,3 +240,21 @@ void DocumentManager::updateDocumentTab()
     mTabWidget->setTabText(index, tabText);
     mTabWidget->setTabToolTip(index, mapDocument->fileName());
 }
+
+void DocumentManager::waitForBackgroundSaves()
+{
+    foreach (MapDocument *mapDocument, mDocuments)
+        mapDocument->waitForBackgroundSave();
+}
+
+void DocumentManager::documentSaved()
+{
+    MapDocument *mapDocument = static_cast<MapDocument*>(sender());
+    emit documentSaved(mapDocument);
+}
+
+void DocumentManager::documentSaveFailed(const QString &error)
+{
+    MapDocument *mapDocument = static_cast<MapDocument*>(sender());
+    emit documentSaveFailed(mapDocument, error);
+}
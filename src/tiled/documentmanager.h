@@ -119,6 +119,15 @@ public:
      */
     QList<MapDocument*> documents() const { return mDocuments; }
 
+    /**
+     * Waits for the saves in the background of all documents to finish.
+     * Needs to be called before changing tilesets, since these can be shared
+     * between documents.
+     *
+     * \sa MapDocument::waitForBackgroundSave()
+     */
+    void waitForBackgroundSaves();
+
 signals:
     /**
      * Emitted when the current displayed map document changed.
@@ -130,6 +139,20 @@ signals:
      */
     void documentCloseRequested(int index);
 
+    /**
+     * Emitted when saving \a mapDocument in the background succeeded.
+     *
+     * \sa MapDocument::saveInBackground()
+     */
+    void documentSaved(MapDocument *mapDocument);
+
+    /**
+     * Emitted when saving \a mapDocument in the background failed.
+     *
+     * \sa MapDocument::saveInBackground()
+     */
+    void documentSaveFailed(MapDocument *mapDocument, const QString &error);
+
 public slots:
     void switchToLeftDocument();
     void switchToRightDocument();
@@ -138,6 +161,8 @@ private slots:
     void currentIndexChanged();
     void setSelectedTool(AbstractTool *tool);
     void updateDocumentTab();
+    void documentSaved();
+    void documentSaveFailed(const QString &error);
 
 private:
     DocumentManager(QObject *parent = 0);
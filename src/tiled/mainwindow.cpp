@@ -31,6 +31,7 @@
 #include "addremovemapobject.h"
 #include "automappingmanager.h"
 #include "addremovetileset.h"
+#include "chunkcache.h"
 #include "clipboardmanager.h"
 #include "createobjecttool.h"
 #include "createtileobjecttool.h"
@@ -226,7 +227,8 @@ MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags)
     connect(mUi->actionOpen, SIGNAL(triggered()), SLOT(openFile()));
     connect(mUi->actionClearRecentFiles, SIGNAL(triggered()),
             SLOT(clearRecentFiles()));
-    connect(mUi->actionSave, SIGNAL(triggered()), SLOT(saveFile()));
+    connect(mUi->actionSave, SIGNAL(triggered()),
+            SLOT(saveFileInBackground()));
     connect(mUi->actionSaveAs, SIGNAL(triggered()), SLOT(saveFileAs()));
     connect(mUi->actionSaveAsImage, SIGNAL(triggered()), SLOT(saveAsImage()));
     connect(mUi->actionExport, SIGNAL(triggered()), SLOT(exportAs()));
@@ -352,6 +354,11 @@ MainWindow::MainWindow(QWidget *parent, Qt::WFlags flags)
             SLOT(mapDocumentChanged(MapDocument*)));
     connect(mDocumentManager, SIGNAL(documentCloseRequested(int)),
             this, SLOT(closeMapDocument(int)));
+    connect(mDocumentManager, SIGNAL(documentSaved(MapDocument*)),
+            SLOT(documentSaved(MapDocument*)));
+    connect(mDocumentManager,
+            SIGNAL(documentSaveFailed(MapDocument*,QString)),
+            SLOT(documentSaveFailed(MapDocument*,QString)));
 
     QShortcut *switchToLeftDocument = new QShortcut(tr("Ctrl+PgUp"), this);
     connect(switchToLeftDocument, SIGNAL(activated()),
@@ -379,6 +386,7 @@ MainWindow::~MainWindow()
     ToolManager::deleteInstance();
     TilesetManager::deleteInstance();
     DocumentManager::deleteInstance();
+    ChunkCache::deleteInstance();
     Preferences::deleteInstance();
     LanguageManager::deleteInstance();
     PluginManager::deleteInstance();
@@ -497,9 +505,40 @@ bool MainWindow::openFile(const QString &fileName,
 
     addMapDocument(new MapDocument(map, fileName));
     setRecentFile(fileName);
+    showLayerDataStatistics(mMapDocument);
     return true;
 }
 
+void MainWindow::showLayerDataStatistics(MapDocument *mapDocument)
+{
+    const QList<MapWriter::LayerDataStatistics> statistics =
+            mapDocument->layerDataStatistics();
+    if (statistics.isEmpty())
+        return;
+
+    int uncompressedSize = 0;
+    int encodedSize = 0;
+    int encodeTime = 0;
+    int reused = 0;
+    foreach (const MapWriter::LayerDataStatistics &layer, statistics) {
+        uncompressedSize += layer.uncompressedSize;
+        encodedSize += layer.encodedSize;
+        encodeTime += layer.encodeTime;
+        if (layer.reused)
+            ++reused;
+    }
+
+    statusBar()->showMessage(tr("Layer data of %1: %2 KB of %3 KB, "
+                                "encoded in %4 ms (%5 of %6 layers reused)")
+                             .arg(mapDocument->displayName())
+                             .arg(encodedSize / 1024)
+                             .arg(uncompressedSize / 1024)
+                             .arg(encodeTime)
+                             .arg(reused)
+                             .arg(statistics.size()),
+                             5000);
+}
+
 bool MainWindow::openFile(const QString &fileName)
 {
     return openFile(fileName, 0);
@@ -634,6 +673,38 @@ bool MainWindow::saveFile()
         return saveFileAs();
 }
 
+/**
+ * Saves the current map without blocking the user interface. The result is
+ * handled by documentSaved() or documentSaveFailed().
+ */
+void MainWindow::saveFileInBackground()
+{
+    if (!mMapDocument)
+        return;
+
+    const QString currentFileName = mMapDocument->fileName();
+
+    if (currentFileName.endsWith(QLatin1String(".tmx"), Qt::CaseInsensitive)) {
+        mMapDocument->saveInBackground(currentFileName);
+    } else {
+        saveFileAs();
+    }
+}
+
+void MainWindow::documentSaved(MapDocument *mapDocument)
+{
+    setRecentFile(mapDocument->fileName());
+    showLayerDataStatistics(mapDocument);
+}
+
+void MainWindow::documentSaveFailed(MapDocument *mapDocument,
+                                    const QString &error)
+{
+    QMessageBox::critical(this, tr("Error Saving Map"),
+                          tr("%1: %2").arg(mapDocument->displayName(),
+                                           error));
+}
+
 bool MainWindow::saveFileAs()
 {
     QString suggestedFileName;
@@ -659,7 +730,12 @@ bool MainWindow::saveFileAs()
 
 bool MainWindow::confirmSave()
 {
-    if (!mMapDocument || !mMapDocument->isModified())
+    if (!mMapDocument)
+        return true;
+
+    // A save in progress may still fail
+    mMapDocument->waitForBackgroundSave();
+    if (!mMapDocument->isModified())
         return true;
 
     int ret = QMessageBox::warning(
@@ -106,6 +106,7 @@ public slots:
     void newMap();
     void openFile();
     bool saveFile();
+    void saveFileInBackground();
     bool saveFileAs();
     void saveAsImage();
     void exportAs();
@@ -148,6 +149,8 @@ public slots:
 
     void mapDocumentChanged(MapDocument *mapDocument);
     void closeMapDocument(int index);
+    void documentSaved(MapDocument *mapDocument);
+    void documentSaveFailed(MapDocument *mapDocument, const QString &error);
 
 private:
     /**
@@ -175,6 +178,12 @@ private:
      */
     bool saveFile(const QString &fileName);
 
+    /**
+     * Shows a summary of the layer data written by the last save of the
+     * given map document in the status bar.
+     */
+    void showLayerDataStatistics(MapDocument *mapDocument);
+
     void writeSettings();
     void readSettings();
 
@@ -46,6 +46,7 @@
 #include <QFileInfo>
 #include <QRect>
 #include <QUndoStack>
+#include <QtConcurrentRun>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -54,7 +55,12 @@ MapDocument::MapDocument(Map *map, const QString &fileName):
     mFileName(fileName),
     mMap(map),
     mLayerModel(new LayerModel(this)),
-    mUndoStack(new QUndoStack(this))
+    mUndoStack(new QUndoStack(this)),
+    mMapWriter(new TmxMapWriter),
+    mSaveWatcher(new QFutureWatcher<QString>(this)),
+    mSavingMap(0),
+    mModificationCount(0),
+    mSavingModificationCount(0)
 {
     switch (map->orientation()) {
     case Map::Isometric:
@@ -76,6 +82,8 @@ MapDocument::MapDocument(Map *map, const QString &fileName):
     connect(mLayerModel, SIGNAL(layerChanged(int)), SIGNAL(layerChanged(int)));
 
     connect(mUndoStack, SIGNAL(cleanChanged(bool)), SIGNAL(modifiedChanged()));
+    connect(mUndoStack, SIGNAL(indexChanged(int)), SLOT(onUndoIndexChanged()));
+    connect(mSaveWatcher, SIGNAL(finished()), SLOT(backgroundSaveFinished()));
 
     // Register tileset references
     TilesetManager *tilesetManager = TilesetManager::instance();
@@ -84,10 +92,18 @@ MapDocument::MapDocument(Map *map, const QString &fileName):
 
 MapDocument::~MapDocument()
 {
+    // The worker thread may still be using the writer and the tilesets
+    mSaveWatcher->waitForFinished();
+    if (mSavingMap) {
+        TilesetManager::instance()->removeReferences(mSavingMap->tilesets());
+        delete mSavingMap;
+    }
+
     // Unregister tileset references
     TilesetManager *tilesetManager = TilesetManager::instance();
     tilesetManager->removeReferences(mMap->tilesets());
 
+    delete mMapWriter;
     delete mRenderer;
     delete mMap;
 }
@@ -99,11 +115,11 @@ bool MapDocument::save(QString *error)
 
 bool MapDocument::save(const QString &fileName, QString *error)
 {
-    TmxMapWriter mapWriter;
+    waitForBackgroundSave();
 
-    if (!mapWriter.write(map(), fileName)) {
+    if (!mMapWriter->write(map(), fileName)) {
         if (error)
-            *error = mapWriter.errorString();
+            *error = mMapWriter->errorString();
         return false;
     }
 
@@ -136,10 +152,113 @@ QString MapDocument::displayName() const
 }
 
 /**
- * Returns whether the map has unsaved changes.
+ * Writes the given \a map snapshot. Runs on a worker thread. Returns the
+ * error message, or an empty string on success.
+ */
+static QString writeSnapshot(TmxMapWriter *writer, const Map *map,
+                             const QString &fileName)
+{
+    if (!writer->writeMap(map, fileName))
+        return writer->errorString();
+
+    return QString();
+}
+
+void MapDocument::saveInBackground(const QString &fileName)
+{
+    waitForBackgroundSave();
+
+    // The layers are cloned, which is cheap since the cells are implicitly
+    // shared. The tilesets are shared with the map. They are referenced
+    // until the save is done, and changes to them wait for the save to
+    // finish (see waitForBackgroundSave()).
+    mSavingMap = mMap->clone();
+    TilesetManager::instance()->addReferences(mSavingMap->tilesets());
+
+    mSavingFileName = fileName;
+    mSavingModificationCount = mModificationCount;
+
+    mMapWriter->readPreferences();
+    mSaveWatcher->setFuture(QtConcurrent::run(writeSnapshot, mMapWriter,
+                                              mSavingMap, fileName));
+
+    // The map is considered saved while the save is in progress
+    emit modifiedChanged();
+}
+
+bool MapDocument::isSaving() const
+{
+    return !mSavingFileName.isEmpty();
+}
+
+void MapDocument::waitForBackgroundSave()
+{
+    if (!isSaving())
+        return;
+
+    mSaveWatcher->waitForFinished();
+    backgroundSaveFinished();
+}
+
+QList<MapWriter::LayerDataStatistics> MapDocument::layerDataStatistics() const
+{
+    return mMapWriter->layerDataStatistics();
+}
+
+void MapDocument::backgroundSaveFinished()
+{
+    // The result may have been handled already by waitForBackgroundSave()
+    if (!isSaving())
+        return;
+
+    const QString fileName = mSavingFileName;
+    mSavingFileName.clear();
+
+    TilesetManager::instance()->removeReferences(mSavingMap->tilesets());
+    delete mSavingMap;
+    mSavingMap = 0;
+
+    const QString error = mSaveWatcher->result();
+    if (!error.isEmpty()) {
+        emit modifiedChanged();
+
+        // This may be called from within an undo command or another action
+        // by waitForBackgroundSave(), so the error is reported once control
+        // returns to the event loop
+        QMetaObject::invokeMethod(this, "saveFailed", Qt::QueuedConnection,
+                                  Q_ARG(QString, error));
+        return;
+    }
+
+    // Only the state at the time the save started was saved. Comparing the
+    // undo index is not enough, since undoing and making another change
+    // would end up at the same index.
+    if (mModificationCount == mSavingModificationCount)
+        mUndoStack->setClean();
+    setFileName(fileName);
+
+    emit modifiedChanged();
+    emit saved();
+}
+
+void MapDocument::onUndoIndexChanged()
+{
+    ++mModificationCount;
+
+    if (isSaving())
+        emit modifiedChanged();
+}
+
+/**
+ * Returns whether the map has unsaved changes. While a background save is
+ * in progress, the map is not modified unless it changed after the save
+ * started.
  */
 bool MapDocument::isModified() const
 {
+    if (isSaving() && mModificationCount == mSavingModificationCount)
+        return false;
+
     return !mUndoStack->isClean();
 }
 
@@ -22,6 +22,9 @@
 #ifndef MAPDOCUMENT_H
 #define MAPDOCUMENT_H
 
+#include "mapwriter.h"
+
+#include <QFutureWatcher>
 #include <QList>
 #include <QObject>
 #include <QRegion>
@@ -44,6 +47,7 @@ namespace Internal {
 
 class LayerModel;
 class TileSelectionModel;
+class TmxMapWriter;
 
 /**
  * Represents an editable map. The purpose of this class is to make sure that
@@ -87,6 +91,38 @@ public:
      */
     bool save(const QString &fileName, QString *error = 0);
 
+    /**
+     * Saves the map to the file at \a fileName on a worker thread, so that
+     * the map can still be edited while it is being saved. The map is saved
+     * the way it is at the time of this call.
+     *
+     * Emits saved() or saveFailed() when done. If the save was successful,
+     * the file name of this document will be set to \a fileName.
+     */
+    void saveInBackground(const QString &fileName);
+
+    /**
+     * Returns whether a save started by saveInBackground() is in progress.
+     */
+    bool isSaving() const;
+
+    /**
+     * Waits for a save started by saveInBackground() to finish and handles
+     * its result right away, though saveFailed() is only delivered once
+     * control returns to the event loop. The worker thread reads the
+     * tilesets, so this needs to be called before changing them.
+     *
+     * \sa DocumentManager::waitForBackgroundSaves()
+     */
+    void waitForBackgroundSave();
+
+    /**
+     * Returns the statistics about the layer data written by the last
+     * successful save. Should not be called while a background save is in
+     * progress.
+     */
+    QList<MapWriter::LayerDataStatistics> layerDataStatistics() const;
+
     QString fileName() const { return mFileName; }
     void setFileName(const QString &fileName);
 
@@ -232,6 +268,18 @@ signals:
     void fileNameChanged();
     void modifiedChanged();
 
+    /**
+     * Emitted when a save started by saveInBackground() succeeded.
+     */
+    void saved();
+
+    /**
+     * Emitted when a save started by saveInBackground() failed. This signal
+     * is delivered through the event loop, so that the error can be shown
+     * without interrupting the action that waited for the save.
+     */
+    void saveFailed(const QString &error);
+
     /**
      * Emitted when the selected tile region changes. Sends the currently
      * selected region and the previously selected region.
@@ -290,6 +338,9 @@ private slots:
     void onLayerAboutToBeRemoved(int index);
     void onLayerRemoved(int index);
 
+    void backgroundSaveFinished();
+    void onUndoIndexChanged();
+
 private:
     void deselectObjects(const QList<MapObject*> &objects);
 
@@ -301,6 +352,12 @@ private:
     MapRenderer *mRenderer;
     int mCurrentLayerIndex;
     QUndoStack *mUndoStack;
+    TmxMapWriter *mMapWriter;   // Kept to reuse data of unchanged layers
+    QFutureWatcher<QString> *mSaveWatcher;
+    Map *mSavingMap;
+    QString mSavingFileName;
+    int mModificationCount;     // Counts changes to the undo stack
+    int mSavingModificationCount;
 };
 
 } // namespace Internal
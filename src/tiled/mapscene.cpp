@@ -24,6 +24,7 @@
 #include "mapscene.h"
 
 #include "abstracttool.h"
+#include "compositelayeritem.h"
 #include "map.h"
 #include "mapdocument.h"
 #include "mapobject.h"
@@ -48,6 +49,10 @@
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+// The minimum number of adjacent tile layers that are flattened into a
+// CompositeLayerItem
+static const int MINIMUM_COMPOSITE_LAYERS = 2;
+
 MapScene::MapScene(QObject *parent):
     QGraphicsScene(parent),
     mMapDocument(0),
@@ -131,15 +136,19 @@ void MapScene::refreshScene()
 {
     mSelectedObjectGroupItem = 0;
     mLayerItems.clear();
+    mCompositeItems.clear();
     mObjectItems.clear();
 
     clear();
 
     if (!mMapDocument) {
+        mOcclusionCuller.setMap(0);
         setSceneRect(QRectF());
         return;
     }
 
+    mOcclusionCuller.setMap(mMapDocument->map());
+
     const QSize mapSize = mMapDocument->renderer()->mapSize();
     setSceneRect(0, 0, mapSize.width(), mapSize.height());
 
@@ -155,6 +164,8 @@ void MapScene::refreshScene()
         ++layerIndex;
     }
 
+    updateComposites();
+
     TileSelectionItem *selectionItem = new TileSelectionItem(mMapDocument);
     selectionItem->setZValue(10000 - 1);
     addItem(selectionItem);
@@ -165,7 +176,8 @@ QGraphicsItem *MapScene::createLayerItem(Layer *layer)
     QGraphicsItem *layerItem = 0;
 
     if (TileLayer *tl = dynamic_cast<TileLayer*>(layer)) {
-        layerItem = new TileLayerItem(tl, mMapDocument->renderer());
+        layerItem = new TileLayerItem(tl, mMapDocument->renderer(),
+                                      &mOcclusionCuller);
     } else if (ObjectGroup *og = dynamic_cast<ObjectGroup*>(layer)) {
         ObjectGroupItem *ogItem = new ObjectGroupItem(og);
         foreach (MapObject *object, og->objects()) {
@@ -187,9 +199,41 @@ void MapScene::repaintRegion(const QRegion &region)
     const MapRenderer *renderer = mMapDocument->renderer();
     const QSize extra = mMapDocument->map()->extraTileSize();
 
-    foreach (const QRect &r, region.rects())
-        update(renderer->boundingRect(r)
-               .adjusted(0, -extra.height(), extra.width(), 0));
+    mOcclusionCuller.update(region);
+
+    // A changed layer may cover or uncover cells on the layers below it, so
+    // the composites below the topmost changed layer are repainted as well
+    int topChangedIndex = -1;
+    if (mOcclusionCuller.isActive()) {
+        for (int i = mLayerItems.size() - 1; i >= 0; --i) {
+            QGraphicsItem *item = mLayerItems.at(i);
+            TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item);
+            if (tli && tli->layerChanged()) {
+                topChangedIndex = i;
+                break;
+            }
+        }
+    }
+
+    QList<CompositeLayerItem*> changedComposites;
+    foreach (CompositeLayerItem *composite, mCompositeItems)
+        if (composite->layersChanged()
+                || composite->zValue() < topChangedIndex)
+            changedComposites.append(composite);
+
+    foreach (const QRect &r, region.rects()) {
+        const QRectF bounds = renderer->boundingRect(r)
+                .adjusted(0, -extra.height(), extra.width(), 0);
+
+        foreach (QGraphicsItem *item, mLayerItems) {
+            if (TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item))
+                tli->invalidateCache(bounds);
+        }
+        foreach (CompositeLayerItem *composite, changedComposites)
+            composite->invalidateCache(bounds);
+
+        update(bounds);
+    }
 }
 
 /**
@@ -213,6 +257,93 @@ void MapScene::updateInteractionMode()
     mSelectedObjectGroupItem = ogItem;
 }
 
+/**
+ * Determines again which cells are covered on all tile layers. Since this
+ * may change the look of any tile layer, their caches are dropped.
+ */
+void MapScene::updateOcclusion()
+{
+    mOcclusionCuller.update();
+
+    foreach (QGraphicsItem *item, mLayerItems) {
+        if (TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item))
+            tli->invalidateCache();
+    }
+
+    // Composited layers have no contents of their own, so changing them
+    // doesn't cause the composite to be repainted
+    foreach (CompositeLayerItem *composite, mCompositeItems) {
+        composite->invalidateCache();
+        composite->update();
+    }
+}
+
+/**
+ * Flattens each run of adjacent tile layers, other than the current layer,
+ * into a CompositeLayerItem. Only the current layer and the object groups
+ * are then painted separately.
+ */
+void MapScene::updateComposites()
+{
+    const Map *map = mMapDocument->map();
+    const int currentIndex = mMapDocument->currentLayerIndex();
+
+    // Composites of layers that stay together are kept along with their
+    // cache, since changing the current layer often only affects one run
+    QList<CompositeLayerItem*> oldComposites = mCompositeItems;
+    mCompositeItems.clear();
+
+    QList<int> run;
+
+    for (int index = 0; index <= mLayerItems.size(); ++index) {
+        TileLayerItem *tli = 0;
+        if (index < mLayerItems.size())
+            tli = dynamic_cast<TileLayerItem*>(mLayerItems.at(index));
+
+        if (tli && index != currentIndex) {
+            run.append(index);
+            continue;
+        }
+
+        if (tli)
+            tli->setComposited(false);
+
+        const bool composited = run.size() >= MINIMUM_COMPOSITE_LAYERS;
+
+        QList<TileLayer*> layers;
+        foreach (int i, run) {
+            QGraphicsItem *item = mLayerItems.at(i);
+            static_cast<TileLayerItem*>(item)->setComposited(composited);
+            layers.append(static_cast<TileLayer*>(map->layerAt(i)));
+        }
+
+        if (composited) {
+            CompositeLayerItem *composite = 0;
+            foreach (CompositeLayerItem *old, oldComposites) {
+                if (old->layers() == layers) {
+                    composite = old;
+                    oldComposites.removeOne(old);
+                    break;
+                }
+            }
+
+            if (!composite) {
+                composite = new CompositeLayerItem(layers,
+                                                   mMapDocument->renderer(),
+                                                   &mOcclusionCuller);
+                addItem(composite);
+            }
+
+            composite->setZValue(run.last() + 0.5);
+            mCompositeItems.append(composite);
+        }
+
+        run.clear();
+    }
+
+    qDeleteAll(oldComposites);
+}
+
 void MapScene::enableSelectedTool()
 {
     if (!mSelectedTool || !mMapDocument)
@@ -245,6 +376,7 @@ void MapScene::disableSelectedTool()
 void MapScene::currentLayerIndexChanged()
 {
     updateInteractionMode();
+    updateComposites();
 }
 
 /**
@@ -259,6 +391,10 @@ void MapScene::mapChanged()
         if (TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item))
             tli->syncWithTileLayer();
     }
+    foreach (CompositeLayerItem *composite, mCompositeItems)
+        composite->syncWithTileLayers();
+
+    updateOcclusion();
 }
 
 void MapScene::tilesetChanged(Tileset *tileset)
@@ -266,8 +402,11 @@ void MapScene::tilesetChanged(Tileset *tileset)
     if (!mMapDocument)
         return;
 
-    if (mMapDocument->map()->tilesets().contains(tileset))
+    if (mMapDocument->map()->tilesets().contains(tileset)) {
+        mOcclusionCuller.clearTileCache();
+        updateOcclusion();
         update();
+    }
 }
 
 void MapScene::layerAdded(int index)
@@ -280,6 +419,9 @@ void MapScene::layerAdded(int index)
     int z = 0;
     foreach (QGraphicsItem *item, mLayerItems)
         item->setZValue(z++);
+
+    updateComposites();
+    updateOcclusion();
 }
 
 void MapScene::layerRemoved(int index)
@@ -290,6 +432,9 @@ void MapScene::layerRemoved(int index)
 
     delete layerItem;
     mLayerItems.remove(index);
+
+    updateComposites();
+    updateOcclusion();
 }
 
 /**
@@ -301,12 +446,21 @@ void MapScene::layerChanged(int index)
     const Layer *layer = mMapDocument->map()->layerAt(index);
     QGraphicsItem *layerItem = mLayerItems.at(index);
 
+    bool occlusionChanged = false;
+
     if (layer->isVisible() != layerItem->isVisible()) {
         layerItem->setVisible(layer->isVisible());
         updateInteractionMode();
+        occlusionChanged = true;
     }
-    if (layer->opacity() != layerItem->opacity())
+    if (layer->opacity() != layerItem->opacity()) {
         layerItem->setOpacity(layer->opacity());
+        occlusionChanged = true;
+    }
+
+    // The cells of a tile layer may hide those of the layers below it
+    if (occlusionChanged && dynamic_cast<const TileLayer*>(layer))
+        updateOcclusion();
 }
 
 /**
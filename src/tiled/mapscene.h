@@ -24,6 +24,8 @@
 #ifndef MAPSCENE_H
 #define MAPSCENE_H
 
+#include "occlusionculler.h"
+
 #include <QGraphicsScene>
 #include <QMap>
 #include <QSet>
@@ -37,6 +39,7 @@ class Tileset;
 namespace Internal {
 
 class AbstractTool;
+class CompositeLayerItem;
 class MapDocument;
 class MapObjectItem;
 class MapScene;
@@ -169,6 +172,8 @@ private:
     QGraphicsItem *createLayerItem(Layer *layer);
 
     void updateInteractionMode();
+    void updateOcclusion();
+    void updateComposites();
 
     bool eventFilter(QObject *object, QEvent *event);
 
@@ -181,6 +186,8 @@ private:
     Qt::KeyboardModifiers mCurrentModifiers;
     QPointF mLastMousePos;
     QVector<QGraphicsItem*> mLayerItems;
+    QList<CompositeLayerItem*> mCompositeItems;
+    OcclusionCuller mOcclusionCuller;
 
     typedef QMap<MapObject*, MapObjectItem*> ObjectItems;
     ObjectItems mObjectItems;
@@ -54,6 +54,11 @@ Preferences::Preferences()
     mLayerDataFormat = (MapWriter::LayerDataFormat)
                        mSettings->value(QLatin1String("LayerDataFormat"),
                                         MapWriter::Base64Zlib).toInt();
+    mCompressionLevel =
+            mSettings->value(QLatin1String("CompressionLevel"), -1).toInt();
+    mCompressionStrategy = (CompressionStrategy)
+            mSettings->value(QLatin1String("CompressionStrategy"),
+                             DefaultStrategy).toInt();
     mDtdEnabled = mSettings->value(QLatin1String("DtdEnabled")).toBool();
     mReloadTilesetsOnChange =
             mSettings->value(QLatin1String("ReloadTilesets"), true).toBool();
@@ -126,6 +131,29 @@ void Preferences::setLayerDataFormat(MapWriter::LayerDataFormat
                         mLayerDataFormat);
 }
 
+int Preferences::compressionLevel() const
+{
+    return mCompressionLevel;
+}
+
+void Preferences::setCompressionLevel(int level)
+{
+    mCompressionLevel = level;
+    mSettings->setValue(QLatin1String("Storage/CompressionLevel"), level);
+}
+
+CompressionStrategy Preferences::compressionStrategy() const
+{
+    return mCompressionStrategy;
+}
+
+void Preferences::setCompressionStrategy(CompressionStrategy strategy)
+{
+    mCompressionStrategy = strategy;
+    mSettings->setValue(QLatin1String("Storage/CompressionStrategy"),
+                        strategy);
+}
+
 bool Preferences::dtdEnabled() const
 {
     return mDtdEnabled;
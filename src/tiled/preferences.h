@@ -49,6 +49,12 @@ public:
     MapWriter::LayerDataFormat layerDataFormat() const;
     void setLayerDataFormat(MapWriter::LayerDataFormat layerDataFormat);
 
+    int compressionLevel() const;
+    void setCompressionLevel(int level);
+
+    CompressionStrategy compressionStrategy() const;
+    void setCompressionStrategy(CompressionStrategy strategy);
+
     bool dtdEnabled() const;
     void setDtdEnabled(bool enabled);
 
@@ -99,6 +105,8 @@ private:
     bool mSnapToGrid;
 
     MapWriter::LayerDataFormat mLayerDataFormat;
+    int mCompressionLevel;
+    CompressionStrategy mCompressionStrategy;
     bool mDtdEnabled;
     QString mLanguage;
     bool mReloadTilesetsOnChange;
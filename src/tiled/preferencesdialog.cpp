@@ -21,6 +21,7 @@
 #include "preferencesdialog.h"
 #include "ui_preferencesdialog.h"
 
+#include "compression.h"
 #include "languagemanager.h"
 #include "objecttypesmodel.h"
 #include "preferences.h"
@@ -29,6 +30,7 @@
 #include <QColorDialog>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QStandardItemModel>
 #include <QStyledItemDelegate>
 
 #ifndef QT_NO_OPENGL
@@ -108,6 +110,8 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     mUi->openGL->setEnabled(false);
 #endif
 
+    disableUnsupportedFormats();
+
     foreach (const QString &name, mLanguages) {
         QLocale locale(name);
         QString string = QString(QLatin1String("%1 (%2)"))
@@ -134,6 +138,8 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     connect(mUi->languageCombo, SIGNAL(currentIndexChanged(int)),
             SLOT(languageSelected(int)));
     connect(mUi->openGL, SIGNAL(toggled(bool)), SLOT(useOpenGLToggled(bool)));
+    connect(mUi->layerDataCombo, SIGNAL(currentIndexChanged(int)),
+            SLOT(updateCompressionLevelRange()));
 
     connect(mUi->objectTypesTable->selectionModel(),
             SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
@@ -167,8 +173,12 @@ void PreferencesDialog::changeEvent(QEvent *e)
     switch (e->type()) {
     case QEvent::LanguageChange: {
             const int formatIndex = mUi->layerDataCombo->currentIndex();
+            const int strategyIndex =
+                    mUi->compressionStrategyCombo->currentIndex();
             mUi->retranslateUi(this);
+            disableUnsupportedFormats();
             mUi->layerDataCombo->setCurrentIndex(formatIndex);
+            mUi->compressionStrategyCombo->setCurrentIndex(strategyIndex);
             mUi->languageCombo->setItemText(0, tr("System default"));
         }
         break;
@@ -189,6 +199,32 @@ void PreferencesDialog::useOpenGLToggled(bool useOpenGL)
     Preferences::instance()->setUseOpenGL(useOpenGL);
 }
 
+/**
+ * Limits the compression level to the range supported by the compression
+ * method of the selected layer data format.
+ */
+void PreferencesDialog::updateCompressionLevelRange()
+{
+    int maximum = 0;
+    switch (layerDataFormat()) {
+    case MapWriter::Base64Gzip:
+    case MapWriter::Base64Zlib:
+        maximum = 9;
+        break;
+    case MapWriter::Base64Zstandard:
+        maximum = 22;
+        break;
+    case MapWriter::Base64LZ4:
+        maximum = 12;
+        break;
+    default:
+        break;
+    }
+
+    mUi->compressionLevel->setMaximum(maximum);
+    mUi->compressionLevel->setEnabled(maximum > 0);
+}
+
 void PreferencesDialog::addObjectType()
 {
     const int newRow = mObjectTypesModel->objectTypes().size();
@@ -308,8 +344,18 @@ void PreferencesDialog::fromPreferences()
     case MapWriter::CSV:
         formatIndex = 4;
         break;
+    case MapWriter::Base64Zstandard:
+        formatIndex = 5;
+        break;
+    case MapWriter::Base64LZ4:
+        formatIndex = 6;
+        break;
     }
     mUi->layerDataCombo->setCurrentIndex(formatIndex);
+    updateCompressionLevelRange();
+    mUi->compressionLevel->setValue(prefs->compressionLevel());
+    mUi->compressionStrategyCombo->setCurrentIndex(
+                prefs->compressionStrategy());
 
     // Not found (-1) ends up at index 0, system default
     int languageIndex = mUi->languageCombo->findData(prefs->language());
@@ -327,6 +373,24 @@ void PreferencesDialog::toPreferences()
     prefs->setReloadTilesetsOnChanged(mUi->reloadTilesetImages->isChecked());
     prefs->setDtdEnabled(mUi->enableDtd->isChecked());
     prefs->setLayerDataFormat(layerDataFormat());
+    prefs->setCompressionLevel(mUi->compressionLevel->value());
+    prefs->setCompressionStrategy((CompressionStrategy)
+                                  mUi->compressionStrategyCombo->currentIndex());
+}
+
+/**
+ * Disables the layer data formats using a compression method that is not
+ * available in this build. Needs to be repeated after retranslateUi(), which
+ * recreates the items.
+ */
+void PreferencesDialog::disableUnsupportedFormats()
+{
+    QStandardItemModel *formatModel =
+            static_cast<QStandardItemModel*>(mUi->layerDataCombo->model());
+    if (!isCompressionMethodSupported(Zstandard))
+        formatModel->item(5)->setEnabled(false);
+    if (!isCompressionMethodSupported(LZ4))
+        formatModel->item(6)->setEnabled(false);
 }
 
 MapWriter::LayerDataFormat PreferencesDialog::layerDataFormat() const
@@ -343,5 +407,9 @@ MapWriter::LayerDataFormat PreferencesDialog::layerDataFormat() const
         return MapWriter::Base64Zlib;
     case 4:
         return MapWriter::CSV;
+    case 5:
+        return MapWriter::Base64Zstandard;
+    case 6:
+        return MapWriter::Base64LZ4;
     }
 }
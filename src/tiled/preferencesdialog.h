@@ -54,6 +54,7 @@ protected:
 private slots:
     void languageSelected(int index);
     void useOpenGLToggled(bool useOpenGL);
+    void updateCompressionLevelRange();
 
     void addObjectType();
     void selectedObjectTypesChanged();
@@ -67,6 +68,7 @@ private:
     void fromPreferences();
     void toPreferences();
 
+    void disableUnsupportedFormats();
     MapWriter::LayerDataFormat layerDataFormat() const;
 
     Ui::PreferencesDialog *mUi;
@@ -26,22 +26,97 @@
 #include "mapobjectitem.h"
 #include "maprenderer.h"
 #include "objectgroup.h"
+#include "occlusionculler.h"
+#include "pngstreamwriter.h"
 #include "preferences.h"
 #include "tilelayer.h"
 #include "utils.h"
 
+#include <QEventLoop>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #include <QImageWriter>
+#include <QProgressDialog>
 #include <QSettings>
+#include <QtConcurrentRun>
 
 static const char * const VISIBLE_ONLY_KEY = "SaveAsImage/VisibleLayersOnly";
 static const char * const CURRENT_SCALE_KEY = "SaveAsImage/CurrentScale";
 static const char * const DRAW_GRID_KEY = "SaveAsImage/DrawGrid";
 
+// The height of the strips the image is rendered in, in pixels
+static const int STRIP_HEIGHT = 256;
+
+// The maximum size of the bands written to a PNG file, in bytes
+static const int MAX_BAND_BYTES = 32 * 1024 * 1024;
+
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+/**
+ * Renders the part of the map that falls within \a strip, in coordinates
+ * of the exported image. The given \a image covers the exported image
+ * starting at \a offset. The renderer takes care of the tiles that stick
+ * into the strip from outside, when they are larger than the tile grid.
+ */
+static void renderStrip(QImage *image, const QRect &strip,
+                        const QPoint &offset,
+                        MapRenderer *renderer, qreal scale,
+                        bool visibleLayersOnly, bool drawTileGrid,
+                        const OcclusionCuller &culler)
+{
+    QPainter painter(image);
+    painter.setClipRect(strip.translated(-offset));
+    painter.translate(-offset);
+
+    if (scale != qreal(1)) {
+        painter.setRenderHints(QPainter::SmoothPixmapTransform |
+                               QPainter::HighQualityAntialiasing);
+        painter.scale(scale, scale);
+    }
+
+    const QRectF exposed(strip.x() / scale, strip.y() / scale,
+                         strip.width() / scale, strip.height() / scale);
+
+    foreach (const Layer *layer, renderer->map()->layers()) {
+        if (visibleLayersOnly && !layer->isVisible())
+            continue;
+
+        painter.setOpacity(layer->opacity());
+
+        const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer);
+        const ObjectGroup *objGroup = dynamic_cast<const ObjectGroup*>(layer);
+
+        if (tileLayer) {
+            renderer->drawTileLayer(&painter, tileLayer, exposed,
+                                    culler.coveredCells(tileLayer));
+        } else if (objGroup) {
+            foreach (const MapObject *object, objGroup->objects()) {
+                const QColor color = MapObjectItem::objectColor(object);
+                renderer->drawMapObjectDecorate(&painter, object,
+                                                color, drawTileGrid);
+            }
+        }
+    }
+
+    if (drawTileGrid)
+        renderer->drawGrid(&painter, exposed);
+}
+
+/**
+ * Saves the given \a image. Runs on a worker thread. Returns the error
+ * message, or an empty string on success.
+ */
+static QString saveImage(const QImage &image, const QString &fileName)
+{
+    QImageWriter writer(fileName);
+    if (!writer.write(image))
+        return writer.errorString();
+
+    return QString();
+}
+
 QString SaveAsImageDialog::mPath;
 
 SaveAsImageDialog::SaveAsImageDialog(MapDocument *mapDocument,
@@ -131,41 +206,21 @@ void SaveAsImageDialog::accept()
     if (useCurrentScale)
         mapSize *= mCurrentScale;
 
-    QImage image(mapSize, QImage::Format_ARGB32);
-    image.fill(Qt::transparent);
-    QPainter painter(&image);
-
-    if (useCurrentScale && mCurrentScale != qreal(1)) {
-        painter.setRenderHints(QPainter::SmoothPixmapTransform |
-                               QPainter::HighQualityAntialiasing);
-        painter.setTransform(QTransform::fromScale(mCurrentScale,
-                                                   mCurrentScale));
-    }
-
-    foreach (const Layer *layer, mMapDocument->map()->layers()) {
-        if (visibleLayersOnly && !layer->isVisible())
-            continue;
-
-        painter.setOpacity(layer->opacity());
-
-        const TileLayer *tileLayer = dynamic_cast<const TileLayer*>(layer);
-        const ObjectGroup *objGroup = dynamic_cast<const ObjectGroup*>(layer);
+    const qreal scale = useCurrentScale ? mCurrentScale : qreal(1);
 
-        if (tileLayer) {
-            renderer->drawTileLayer(&painter, tileLayer);
-        } else if (objGroup) {
-            foreach (const MapObject *object, objGroup->objects()) {
-                const QColor color = MapObjectItem::objectColor(object);
-                renderer->drawMapObjectDecorate(&painter, object,
-                                                color, drawTileGrid);
-            }
-        }
-    }
+    // PNG images are written while they are being rendered, so that maps of
+    // any size can be exported
+    const bool streamed = QFileInfo(fileName).suffix()
+            .compare(QLatin1String("png"), Qt::CaseInsensitive) == 0;
 
-    if (drawTileGrid)
-        renderer->drawGrid(&painter, QRectF(QPointF(), renderer->mapSize()));
+    const bool exported = streamed
+            ? exportPng(fileName, mapSize, scale,
+                        visibleLayersOnly, drawTileGrid)
+            : exportImage(fileName, mapSize, scale,
+                          visibleLayersOnly, drawTileGrid);
+    if (!exported)
+        return;
 
-    image.save(fileName);
     mPath = QFileInfo(fileName).path();
 
     // Store settings for next time
@@ -177,6 +232,148 @@ void SaveAsImageDialog::accept()
     QDialog::accept();
 }
 
+/**
+ * Renders the whole image before saving it, for the formats that can't be
+ * written incrementally. Returns false when cancelled or when writing
+ * failed.
+ */
+bool SaveAsImageDialog::exportImage(const QString &fileName,
+                                    const QSize &size, qreal scale,
+                                    bool visibleLayersOnly,
+                                    bool drawTileGrid)
+{
+    MapRenderer *renderer = mMapDocument->renderer();
+
+    QImage image(size, QImage::Format_ARGB32);
+    image.fill(Qt::transparent);
+
+    // Skip the cells hidden behind opaque tiles on visible layers above
+    OcclusionCuller culler;
+    culler.setMap(mMapDocument->map());
+
+    // Render the image in horizontal strips, so that the progress can be
+    // shown and the export can be cancelled
+    const int stripCount =
+            (size.height() + STRIP_HEIGHT - 1) / STRIP_HEIGHT;
+
+    QProgressDialog progress(tr("Rendering image..."), tr("Cancel"),
+                             0, stripCount + 1, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    for (int strip = 0; strip < stripCount; ++strip) {
+        // Also processes pending events, since the dialog is modal
+        progress.setValue(strip);
+        if (progress.wasCanceled())
+            return false;
+
+        const int y = strip * STRIP_HEIGHT;
+        const QRect stripRect(0, y, size.width(),
+                              qMin(STRIP_HEIGHT, size.height() - y));
+
+        renderStrip(&image, stripRect, QPoint(), renderer, scale,
+                    visibleLayersOnly, drawTileGrid, culler);
+    }
+
+    // Encoding a large image takes a while, so keep the interface
+    // responsive while it is written in the background
+    progress.setLabelText(tr("Saving image..."));
+    progress.setCancelButton(0);
+    progress.setValue(stripCount);
+
+    QFutureWatcher<QString> watcher;
+    QEventLoop loop;
+    connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+    watcher.setFuture(QtConcurrent::run(saveImage, image, fileName));
+    if (!watcher.isFinished())
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+
+    progress.setValue(stripCount + 1);
+
+    const QString error = watcher.result();
+    if (!error.isEmpty()) {
+        QMessageBox::critical(this, tr("Error Saving Image"), error);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Renders the image in bands that are written to a PNG file one after the
+ * other, so that only a few bands are kept in memory. Returns false when
+ * cancelled or when writing failed.
+ */
+bool SaveAsImageDialog::exportPng(const QString &fileName,
+                                  const QSize &size, qreal scale,
+                                  bool visibleLayersOnly,
+                                  bool drawTileGrid)
+{
+    PngStreamWriter writer;
+    if (!writer.open(fileName, size)) {
+        QMessageBox::critical(this, tr("Error Saving Image"),
+                              writer.errorString());
+        return false;
+    }
+
+    MapRenderer *renderer = mMapDocument->renderer();
+
+    // Skip the cells hidden behind opaque tiles on visible layers above
+    OcclusionCuller culler;
+    culler.setMap(mMapDocument->map());
+
+    // Limit the memory used by a band for very wide images
+    const int rowBytes = qMax(1, size.width() * 4);
+    const int bandHeight = qBound(1, MAX_BAND_BYTES / rowBytes, STRIP_HEIGHT);
+    const int bandCount = (size.height() + bandHeight - 1) / bandHeight;
+
+    QProgressDialog progress(tr("Rendering image..."), tr("Cancel"),
+                             0, bandCount, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    // Each band is compressed in the background while the next one is
+    // being rendered
+    QFuture<bool> written;
+
+    for (int band = 0; band < bandCount; ++band) {
+        // Also processes pending events, since the dialog is modal
+        progress.setValue(band);
+        if (progress.wasCanceled()) {
+            written.waitForFinished();
+            return false;
+        }
+
+        const int y = band * bandHeight;
+        const QRect bandRect(0, y, size.width(),
+                             qMin(bandHeight, size.height() - y));
+
+        QImage image(bandRect.size(), QImage::Format_ARGB32);
+        image.fill(0);
+
+        renderStrip(&image, bandRect, bandRect.topLeft(), renderer, scale,
+                    visibleLayersOnly, drawTileGrid, culler);
+
+        written.waitForFinished();
+        if (band > 0 && !written.result())
+            break;
+
+        written = QtConcurrent::run(&writer, &PngStreamWriter::writeRows,
+                                    image);
+    }
+
+    written.waitForFinished();
+    progress.setValue(bandCount);
+
+    if (!written.result() || !writer.close()) {
+        QMessageBox::critical(this, tr("Error Saving Image"),
+                              writer.errorString());
+        return false;
+    }
+
+    return true;
+}
+
 void SaveAsImageDialog::browse()
 {
     // Don't confirm overwrite here, since we'll confirm when the user presses
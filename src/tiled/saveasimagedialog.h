@@ -59,6 +59,11 @@ private slots:
     void updateAcceptEnabled();
 
 private:
+    bool exportImage(const QString &fileName, const QSize &size, qreal scale,
+                     bool visibleLayersOnly, bool drawTileGrid);
+    bool exportPng(const QString &fileName, const QSize &size, qreal scale,
+                   bool visibleLayersOnly, bool drawTileGrid);
+
     Ui::SaveAsImageDialog *mUi;
     MapDocument *mMapDocument;
     qreal mCurrentScale;
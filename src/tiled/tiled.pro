@@ -68,9 +68,12 @@ SOURCES += aboutdialog.cpp \
     tilesetmodel.cpp \
     tilesetview.cpp \
     tilelayeritem.cpp \
+    tilelayerpyramid.cpp \
+    compositelayeritem.cpp \
     tmxmapreader.cpp \
     tmxmapwriter.cpp \
     changeproperties.cpp \
+    chunkcache.cpp \
     movelayer.cpp \
     tilepainter.cpp \
     newmapdialog.cpp \
@@ -157,9 +160,12 @@ HEADERS += aboutdialog.h \
     tilesetmodel.h \
     tilesetview.h \
     tilelayeritem.h \
+    tilelayerpyramid.h \
+    compositelayeritem.h \
     tmxmapreader.h \
     tmxmapwriter.h \
     changeproperties.h \
+    chunkcache.h \
     movelayer.h \
     tilepainter.h \
     newmapdialog.h \
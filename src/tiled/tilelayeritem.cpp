@@ -20,20 +20,37 @@
 
 #include "tilelayeritem.h"
 
+#include "chunkcache.h"
 #include "tile.h"
 #include "tilelayer.h"
 #include "map.h"
 #include "maprenderer.h"
+#include "occlusionculler.h"
+#include "tilelayerpyramid.h"
 
-#include <QPainter>
 #include <QStyleOptionGraphicsItem>
+#include <QWidget>
+
+#include <cmath>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
 
-TileLayerItem::TileLayerItem(TileLayer *layer, MapRenderer *renderer)
+namespace {
+
+// The size of the pre-rendered chunks in device pixels
+const int ChunkSize = 512;
+
+} // anonymous namespace
+
+TileLayerItem::TileLayerItem(TileLayer *layer, MapRenderer *renderer,
+                             const OcclusionCuller *culler)
     : mLayer(layer)
     , mRenderer(renderer)
+    , mCuller(culler)
+    , mChunkScale(0)
+    , mCachedGeneration(0)
+    , mPyramid(new TileLayerPyramid(layer, this))
 {
     setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
 
@@ -41,10 +58,50 @@ TileLayerItem::TileLayerItem(TileLayer *layer, MapRenderer *renderer)
     setOpacity(mLayer->opacity());
 }
 
+TileLayerItem::~TileLayerItem()
+{
+    ChunkCache::instance()->clear(this);
+    delete mPyramid;
+}
+
 void TileLayerItem::syncWithTileLayer()
 {
     prepareGeometryChange();
     mBoundingRect = mRenderer->boundingRect(mLayer->bounds());
+    invalidateCache();
+}
+
+void TileLayerItem::invalidateCache()
+{
+    ChunkCache::instance()->clear(this);
+    mPyramid->invalidate();
+    mCachedGeneration = mLayer->generation();
+}
+
+void TileLayerItem::invalidateCache(const QRectF &rect)
+{
+    // Any change to the layer comes with a changed region, so the chunks
+    // outside of it stay valid
+    mCachedGeneration = mLayer->generation();
+    mPyramid->invalidate(rect);
+
+    ChunkCache *cache = ChunkCache::instance();
+    const QRect chunks = chunksIntersecting(rect);
+    for (int y = chunks.top(); y <= chunks.bottom(); ++y)
+        for (int x = chunks.left(); x <= chunks.right(); ++x)
+            cache->remove(this, ChunkIndex(x, y));
+}
+
+bool TileLayerItem::layerChanged() const
+{
+    return mLayer->generation() != mCachedGeneration;
+}
+
+void TileLayerItem::setComposited(bool composited)
+{
+    setFlag(QGraphicsItem::ItemHasNoContents, composited);
+    if (composited)
+        invalidateCache();
 }
 
 QRectF TileLayerItem::boundingRect() const
@@ -54,8 +111,117 @@ QRectF TileLayerItem::boundingRect() const
 
 void TileLayerItem::paint(QPainter *painter,
                           const QStyleOptionGraphicsItem *option,
-                          QWidget *)
+                          QWidget *widget)
 {
     // TODO: Display a border around the layer when selected
-    mRenderer->drawTileLayer(painter, mLayer, option->exposedRect);
+
+    // The chunks can only be blitted as-is when the view is not rotated,
+    // sheared or stretched
+    const QTransform &transform = painter->worldTransform();
+    if (transform.type() > QTransform::TxScale
+            || transform.m11() != transform.m22()
+            || transform.m11() <= 0) {
+        mRenderer->drawTileLayer(painter, mLayer, option->exposedRect,
+                                 coveredCells());
+        return;
+    }
+
+    if (mLayer->generation() != mCachedGeneration)
+        invalidateCache();
+
+    ChunkCache *cache = ChunkCache::instance();
+
+    const qreal scale = transform.m11();
+    if (mPyramid->isUsedAt(scale)) {
+        if (mChunkScale != 0) {
+            cache->clear(this);
+            mChunkScale = 0;
+        }
+        mPyramid->draw(painter, option->exposedRect, scale);
+        return;
+    }
+
+    if (scale != mChunkScale) {
+        cache->clear(this);
+        mChunkScale = scale;
+    }
+
+    const QRect chunks =
+            chunksIntersecting(option->exposedRect & mBoundingRect);
+    if (chunks.isEmpty())
+        return;
+
+    // Make sure the chunks covering the view don't evict each other
+    if (widget) {
+        const QRectF viewRect =
+                transform.inverted().mapRect(QRectF(widget->rect()));
+        const QRect viewChunks = chunksIntersecting(viewRect & mBoundingRect);
+        cache->setVisibleChunks(this, viewChunks.width() * viewChunks.height());
+    }
+
+    const qreal chunkSize = ChunkSize / scale;
+    const QRectF source(0, 0, ChunkSize, ChunkSize);
+
+    for (int y = chunks.top(); y <= chunks.bottom(); ++y) {
+        for (int x = chunks.left(); x <= chunks.right(); ++x) {
+            const QPixmap pixmap = chunk(ChunkIndex(x, y),
+                                         painter->renderHints());
+            const QRectF target(x * chunkSize, y * chunkSize,
+                                chunkSize, chunkSize);
+            painter->drawPixmap(target, pixmap, source);
+        }
+    }
+}
+
+/**
+ * Returns the range of chunks intersecting the given \a rect at the current
+ * scale.
+ */
+QRect TileLayerItem::chunksIntersecting(const QRectF &rect) const
+{
+    if (rect.isEmpty() || mChunkScale <= 0)
+        return QRect();
+
+    const qreal chunkSize = ChunkSize / mChunkScale;
+    const int left = (int) std::floor(rect.left() / chunkSize);
+    const int top = (int) std::floor(rect.top() / chunkSize);
+    const int right = (int) std::floor(rect.right() / chunkSize);
+    const int bottom = (int) std::floor(rect.bottom() / chunkSize);
+
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+/**
+ * Returns the chunk at the given \a index, rendering it when it isn't
+ * cached.
+ */
+QPixmap TileLayerItem::chunk(const ChunkIndex &index,
+                             QPainter::RenderHints hints)
+{
+    ChunkCache *cache = ChunkCache::instance();
+    if (const QPixmap *pixmap = cache->object(this, index))
+        return *pixmap;
+
+    const qreal chunkSize = ChunkSize / mChunkScale;
+    const QRectF rect(index.first * chunkSize, index.second * chunkSize,
+                      chunkSize, chunkSize);
+
+    QPixmap *pixmap = new QPixmap(ChunkSize, ChunkSize);
+    pixmap->fill(Qt::transparent);
+
+    QPainter painter(pixmap);
+    painter.setRenderHints(hints);
+    painter.scale(mChunkScale, mChunkScale);
+    painter.translate(-rect.topLeft());
+    mRenderer->drawTileLayer(&painter, mLayer, rect, coveredCells());
+    painter.end();
+
+    const QPixmap result = *pixmap;
+    cache->insert(this, index, pixmap);
+    return result;
+}
+
+const QBitArray *TileLayerItem::coveredCells() const
+{
+    return mCuller ? mCuller->coveredCells(mLayer) : 0;
 }
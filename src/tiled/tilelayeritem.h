@@ -22,14 +22,20 @@
 #define TILELAYERITEM_H
 
 #include <QGraphicsItem>
+#include <QPair>
+#include <QPainter>
+#include <QPixmap>
 
 namespace Tiled {
 
 class MapRenderer;
+class OcclusionCuller;
 class TileLayer;
 
 namespace Internal {
 
+class TileLayerPyramid;
+
 /**
  * A graphics item displaying a tile layer in a QGraphicsView.
  */
@@ -41,8 +47,12 @@ public:
      *
      * @param layer    the tile layer to be displayed
      * @param renderer the map renderer to use to render the layer
+     * @param culler   determines which cells are hidden by other layers, may
+     *                 be 0
      */
-    TileLayerItem(TileLayer *layer, MapRenderer *renderer);
+    TileLayerItem(TileLayer *layer, MapRenderer *renderer,
+                  const OcclusionCuller *culler = 0);
+    ~TileLayerItem();
 
     /**
      * Updates the size and position of this item. Should be called when the
@@ -54,6 +64,32 @@ public:
      */
     void syncWithTileLayer();
 
+    /**
+     * Drops all pre-rendered chunks of the layer, including those of its
+     * level-of-detail pyramid. Should be called when the
+     * look of the whole layer may have changed, for example because one of
+     * its tilesets was reloaded.
+     */
+    void invalidateCache();
+
+    /**
+     * Drops the pre-rendered chunks intersecting the given \a rect, in
+     * pixel coordinates.
+     */
+    void invalidateCache(const QRectF &rect);
+
+    /**
+     * Returns whether the layer changed since the cache was last
+     * invalidated.
+     */
+    bool layerChanged() const;
+
+    /**
+     * Sets whether the layer is displayed by a CompositeLayerItem instead,
+     * in which case this item doesn't paint anything and drops its cache.
+     */
+    void setComposited(bool composited);
+
     // QGraphicsItem
     QRectF boundingRect() const;
     void paint(QPainter *painter,
@@ -61,9 +97,30 @@ public:
                QWidget *widget = 0);
 
 private:
+    typedef QPair<int, int> ChunkIndex;
+
+    QRect chunksIntersecting(const QRectF &rect) const;
+    QPixmap chunk(const ChunkIndex &index, QPainter::RenderHints hints);
+    const QBitArray *coveredCells() const;
+
     TileLayer *mLayer;
     MapRenderer *mRenderer;
+    const OcclusionCuller *mCuller;
     QRectF mBoundingRect;
+
+    /**
+     * The layer is pre-rendered at the current scale, in chunks of a fixed
+     * size in device pixels that are kept in the ChunkCache. Painting the
+     * layer only composites these.
+     */
+    qreal mChunkScale;
+    uint mCachedGeneration;
+
+    /**
+     * Used instead of the chunks above when zoomed out far enough for the
+     * tiles to be only a few pixels large.
+     */
+    TileLayerPyramid *mPyramid;
 };
 
 } // namespace Internal
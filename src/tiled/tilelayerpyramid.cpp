@@ -0,0 +1,381 @@
+/*
+ * tilelayerpyramid.cpp
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilelayerpyramid.h"
+
+#include "map.h"
+#include "tile.h"
+#include "tilelayer.h"
+
+#include <QGraphicsItem>
+#include <QPainter>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentRun>
+
+#include <cmath>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+namespace {
+
+// The size of the chunks in pixels
+const int ChunkSize = 512;
+
+// The pyramid is used when tiles get smaller than this on the screen
+const int MinimumTileSize = 4;
+
+// The minimum number of chunks kept over all levels
+const int MinimumCachedChunks = 64;
+
+/**
+ * A cell prepared for rendering in a background thread.
+ */
+struct ChunkCell
+{
+    QImage image;
+    QPointF pos;        // The bottom-left corner within the chunk
+    bool flippedHorizontally;
+    bool flippedVertically;
+    int rotation;
+};
+
+QImage renderChunk(const QVector<ChunkCell> &cells)
+{
+    QImage image(ChunkSize, ChunkSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+
+    QPainter painter(&image);
+
+    foreach (const ChunkCell &cell, cells) {
+        const QImage &tileImage = cell.image;
+
+        if (!cell.flippedHorizontally && !cell.flippedVertically
+                && cell.rotation == 0) {
+            painter.drawImage(QPointF(cell.pos.x(),
+                                      cell.pos.y() - tileImage.height()),
+                              tileImage);
+            continue;
+        }
+
+        // Flip and rotate around the center, like Cell::toImage()
+        const bool rotated = cell.rotation % 2;
+        const qreal width = rotated ? tileImage.height() : tileImage.width();
+        const qreal height = rotated ? tileImage.width() : tileImage.height();
+
+        painter.save();
+        painter.translate(cell.pos.x() + width / 2,
+                          cell.pos.y() - height / 2);
+        painter.rotate(90 * cell.rotation);
+        painter.scale(cell.flippedHorizontally ? -1 : 1,
+                      cell.flippedVertically ? -1 : 1);
+        painter.drawImage(QPointF(-tileImage.width() / 2.0,
+                                  -tileImage.height() / 2.0),
+                          tileImage);
+        painter.restore();
+    }
+
+    painter.end();
+    return image;
+}
+
+} // anonymous namespace
+
+TileLayerPyramid::TileLayerPyramid(const TileLayer *layer,
+                                   QGraphicsItem *item)
+    : mLayer(layer)
+    , mItem(item)
+{
+    mChunks.setMaxCost(MinimumCachedChunks);
+}
+
+TileLayerPyramid::~TileLayerPyramid()
+{
+    // The jobs only use their own copy of the cells, so they can be left
+    // to finish on their own
+    foreach (Job *job, mJobs) {
+        delete job->watcher;
+        delete job;
+    }
+}
+
+bool TileLayerPyramid::isUsedAt(qreal scale) const
+{
+    const Map *map = mLayer->map();
+    if (!map || map->orientation() != Map::Orthogonal)
+        return false;
+
+    const int tileSize = qMin(map->tileWidth(), map->tileHeight());
+    return maximumLevel() > 0 && scale * tileSize < MinimumTileSize;
+}
+
+void TileLayerPyramid::draw(QPainter *painter, const QRectF &exposed,
+                            qreal scale)
+{
+    // Use the finest level that isn't smaller than the requested scale
+    const int maxLevel = maximumLevel();
+    int level = 0;
+    while (level < maxLevel && 1.0 / (1 << (level + 1)) >= scale)
+        ++level;
+
+    const QRectF rect = exposed & mItem->boundingRect();
+    if (rect.isEmpty())
+        return;
+
+    const qreal chunkSize = ChunkSize * (1 << level);
+    const int left = (int) std::floor(rect.left() / chunkSize);
+    const int top = (int) std::floor(rect.top() / chunkSize);
+    const int right = (int) std::floor(rect.right() / chunkSize);
+    const int bottom = (int) std::floor(rect.bottom() / chunkSize);
+
+    // Make sure the visible chunks don't evict each other
+    const int visibleChunks = (right - left + 1) * (bottom - top + 1);
+    if (mChunks.maxCost() < visibleChunks * 2)
+        mChunks.setMaxCost(visibleChunks * 2);
+
+    const QRectF source(0, 0, ChunkSize, ChunkSize);
+
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            const PyramidChunk chunk(level, x, y);
+
+            if (const QPixmap *pixmap = mChunks.object(chunk)) {
+                painter->drawPixmap(chunkRect(chunk), *pixmap, source);
+            } else {
+                requestChunk(chunk);
+                drawCoarserChunk(painter, chunk);
+            }
+        }
+    }
+}
+
+void TileLayerPyramid::invalidate()
+{
+    mChunks.clear();
+    mScaledTiles.clear();
+
+    foreach (Job *job, mJobs)
+        job->stale = true;
+}
+
+void TileLayerPyramid::invalidate(const QRectF &rect)
+{
+    const int maxLevel = maximumLevel();
+
+    if (!mChunks.isEmpty()) {
+        for (int level = 0; level <= maxLevel; ++level) {
+            const qreal chunkSize = ChunkSize * (1 << level);
+            const int left = (int) std::floor(rect.left() / chunkSize);
+            const int top = (int) std::floor(rect.top() / chunkSize);
+            const int right = (int) std::floor(rect.right() / chunkSize);
+            const int bottom = (int) std::floor(rect.bottom() / chunkSize);
+
+            for (int y = top; y <= bottom; ++y)
+                for (int x = left; x <= right; ++x)
+                    mChunks.remove(PyramidChunk(level, x, y));
+        }
+    }
+
+    QHash<PyramidChunk, Job*>::const_iterator it = mJobs.constBegin();
+    QHash<PyramidChunk, Job*>::const_iterator it_end = mJobs.constEnd();
+    for (; it != it_end; ++it) {
+        if (chunkRect(it.key()).intersects(rect))
+            it.value()->stale = true;
+    }
+}
+
+void TileLayerPyramid::chunkRendered()
+{
+    QFutureWatcher<QImage> *watcher =
+            static_cast<QFutureWatcher<QImage>*>(sender());
+
+    QHash<PyramidChunk, Job*>::iterator it = mJobs.begin();
+    QHash<PyramidChunk, Job*>::iterator it_end = mJobs.end();
+    while (it != it_end && it.value()->watcher != watcher)
+        ++it;
+
+    if (it == it_end)
+        return;
+
+    Job *job = it.value();
+    if (!job->stale) {
+        const QPixmap pixmap = QPixmap::fromImage(watcher->result());
+        mChunks.insert(it.key(), new QPixmap(pixmap));
+    }
+
+    mJobs.erase(it);
+    watcher->deleteLater();
+    delete job;
+
+    // Also gives the chance to request the next chunks
+    mItem->update();
+}
+
+/**
+ * Returns the level at which tiles are a single pixel large.
+ */
+int TileLayerPyramid::maximumLevel() const
+{
+    const Map *map = mLayer->map();
+    if (!map)
+        return 0;
+
+    const int tileSize = qMin(map->tileWidth(), map->tileHeight());
+    int level = 0;
+    while ((tileSize >> (level + 1)) > 0)
+        ++level;
+    return level;
+}
+
+/**
+ * Returns the area covered by the given \a chunk, in pixel coordinates.
+ */
+QRectF TileLayerPyramid::chunkRect(const PyramidChunk &chunk) const
+{
+    const qreal size = ChunkSize * (1 << chunk.level);
+    return QRectF(chunk.x * size, chunk.y * size, size, size);
+}
+
+/**
+ * Starts rendering the given \a chunk in a background thread. The cells
+ * are collected here, so that the layer is never accessed from another
+ * thread.
+ */
+void TileLayerPyramid::requestChunk(const PyramidChunk &chunk)
+{
+    if (mJobs.contains(chunk))
+        return;
+
+    // Don't stall the interface by collecting the cells of too many chunks
+    // at once. More are requested as the jobs finish.
+    if (mJobs.size() >= QThread::idealThreadCount() * 2)
+        return;
+
+    const Map *map = mLayer->map();
+    const int tileWidth = map->tileWidth();
+    const int tileHeight = map->tileHeight();
+    const qreal levelScale = 1.0 / (1 << chunk.level);
+    const QPointF layerPos(mLayer->x() * tileWidth,
+                           mLayer->y() * tileHeight);
+
+    // Include the tiles sticking into the chunk from outside
+    const QSize maxTileSize = mLayer->maxTileSize();
+    const int extraWidth = maxTileSize.width() - tileWidth;
+    const int extraHeight = maxTileSize.height() - tileHeight;
+    QRectF rect = chunkRect(chunk).adjusted(-extraWidth, 0, 0, extraHeight);
+    rect.translate(-layerPos);
+
+    const int startX = qMax((int) std::floor(rect.left() / tileWidth), 0);
+    const int startY = qMax((int) std::floor(rect.top() / tileHeight), 0);
+    const int endX = qMin((int) std::ceil(rect.right() / tileWidth),
+                          mLayer->width());
+    const int endY = qMin((int) std::ceil(rect.bottom() / tileHeight),
+                          mLayer->height());
+
+    const QPointF origin(chunk.x * ChunkSize, chunk.y * ChunkSize);
+
+    QVector<ChunkCell> cells;
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX; ++x) {
+            const Cell &cell = mLayer->cellAt(x, y);
+            if (cell.isEmpty())
+                continue;
+
+            ChunkCell chunkCell;
+            chunkCell.image = scaledTileImage(cell.tile, chunk.level);
+            chunkCell.pos = QPointF(layerPos.x() + x * tileWidth,
+                                    layerPos.y() + (y + 1) * tileHeight)
+                    * levelScale - origin;
+            chunkCell.flippedHorizontally = cell.flippedHorizontally;
+            chunkCell.flippedVertically = cell.flippedVertically;
+            chunkCell.rotation = cell.ang % 4;
+            cells.append(chunkCell);
+        }
+    }
+
+    Job *job = new Job;
+    job->watcher = new QFutureWatcher<QImage>;
+    job->stale = false;
+    connect(job->watcher, SIGNAL(finished()), SLOT(chunkRendered()));
+    mJobs.insert(chunk, job);
+
+    job->watcher->setFuture(QtConcurrent::run(renderChunk, cells));
+}
+
+/**
+ * Draws the part of a cached chunk of a coarser level that covers the given
+ * \a chunk. Returns whether one was available.
+ */
+bool TileLayerPyramid::drawCoarserChunk(QPainter *painter,
+                                        const PyramidChunk &chunk)
+{
+    const int maxLevel = maximumLevel();
+
+    for (int level = chunk.level + 1; level <= maxLevel; ++level) {
+        const int shift = level - chunk.level;
+        const PyramidChunk coarser(level, chunk.x >> shift,
+                                   chunk.y >> shift);
+
+        if (const QPixmap *pixmap = mChunks.object(coarser)) {
+            const qreal size = ChunkSize >> shift;
+            const QRectF source((chunk.x - (coarser.x << shift)) * size,
+                                (chunk.y - (coarser.y << shift)) * size,
+                                size, size);
+            painter->drawPixmap(chunkRect(chunk), *pixmap, source);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns the image of the given \a tile scaled down for the given pyramid
+ * \a level. It is halved repeatedly, so that each pixel is averaged from
+ * all the pixels it covers.
+ */
+QImage TileLayerPyramid::scaledTileImage(const Tile *tile, int level)
+{
+    const QPair<const Tile*, int> key(tile, level);
+
+    QHash<QPair<const Tile*, int>, QImage>::const_iterator it =
+            mScaledTiles.find(key);
+    if (it != mScaledTiles.end())
+        return it.value();
+
+    const qreal levelScale = 1.0 / (1 << level);
+    const int width = qMax(1, (int) std::ceil(tile->width() * levelScale));
+    const int height = qMax(1, (int) std::ceil(tile->height() * levelScale));
+
+    QImage image = tile->image().toImage();
+    while (image.width() > width * 2 || image.height() > height * 2) {
+        image = image.scaled(qMax(width, image.width() / 2),
+                             qMax(height, image.height() / 2),
+                             Qt::IgnoreAspectRatio,
+                             Qt::SmoothTransformation);
+    }
+    image = image.scaled(width, height,
+                         Qt::IgnoreAspectRatio,
+                         Qt::SmoothTransformation)
+            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    mScaledTiles.insert(key, image);
+    return image;
+}
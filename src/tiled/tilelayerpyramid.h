@@ -0,0 +1,136 @@
+/*
+ * tilelayerpyramid.h
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILELAYERPYRAMID_H
+#define TILELAYERPYRAMID_H
+
+#include <QCache>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPair>
+#include <QPixmap>
+#include <QRectF>
+
+class QGraphicsItem;
+class QPainter;
+
+namespace Tiled {
+
+class Tile;
+class TileLayer;
+
+namespace Internal {
+
+/**
+ * Identifies a chunk of a level of the pyramid.
+ */
+struct PyramidChunk
+{
+    PyramidChunk(int level, int x, int y) : level(level), x(x), y(y) {}
+
+    bool operator == (const PyramidChunk &other) const
+    { return level == other.level && x == other.x && y == other.y; }
+
+    int level;
+    int x;
+    int y;
+};
+
+inline uint qHash(const PyramidChunk &chunk)
+{
+    return (chunk.level << 28) ^ (chunk.y << 14) ^ chunk.x;
+}
+
+/**
+ * A mipmap-style pyramid of an orthogonal tile layer, used to draw the
+ * layer when its tiles are only a few pixels large on the screen. Level n
+ * of the pyramid renders the layer at a scale of 1 / 2^n, down to tiles of
+ * a single pixel.
+ *
+ * Each level is split into chunks, which are rendered on demand in
+ * background threads from scaled down copies of the tile images. While a
+ * chunk is being rendered, a coarser level is drawn in its place when
+ * available.
+ */
+class TileLayerPyramid : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param layer the tile layer to render
+     * @param item  the item that is updated when chunks become available
+     */
+    TileLayerPyramid(const TileLayer *layer, QGraphicsItem *item);
+    ~TileLayerPyramid();
+
+    /**
+     * Returns whether the pyramid should be used to draw the layer at the
+     * given \a scale.
+     */
+    bool isUsedAt(qreal scale) const;
+
+    /**
+     * Draws the chunks of the pyramid level matching the given \a scale that
+     * intersect \a exposed, requesting those that are not available.
+     */
+    void draw(QPainter *painter, const QRectF &exposed, qreal scale);
+
+    /**
+     * Drops all chunks and the scaled tile images.
+     */
+    void invalidate();
+
+    /**
+     * Drops the chunks on all levels that intersect the given \a rect, in
+     * pixel coordinates.
+     */
+    void invalidate(const QRectF &rect);
+
+private slots:
+    void chunkRendered();
+
+private:
+    struct Job {
+        QFutureWatcher<QImage> *watcher;
+        bool stale;     // Set when the chunk changed during rendering
+    };
+
+    int maximumLevel() const;
+    QRectF chunkRect(const PyramidChunk &chunk) const;
+    void requestChunk(const PyramidChunk &chunk);
+    bool drawCoarserChunk(QPainter *painter, const PyramidChunk &chunk);
+    QImage scaledTileImage(const Tile *tile, int level);
+
+    const TileLayer *mLayer;
+    QGraphicsItem *mItem;
+
+    QCache<PyramidChunk, QPixmap> mChunks;
+    QHash<PyramidChunk, Job*> mJobs;
+    QHash<QPair<const Tile*, int>, QImage> mScaledTiles;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // TILELAYERPYRAMID_H
@@ -32,6 +32,10 @@
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+// Selections consisting of at least this many rectangles are drawn from a
+// mask, so that their drawing time doesn't depend on how fragmented they are
+static const int MASK_RECT_COUNT = 64;
+
 TileSelectionItem::TileSelectionItem(MapDocument *mapDocument)
     : mMapDocument(mapDocument)
 {
@@ -57,8 +61,19 @@ void TileSelectionItem::paint(QPainter *painter,
     highlight.setAlpha(128);
 
     MapRenderer *renderer = mMapDocument->renderer();
-    renderer->drawTileSelection(painter, selection, highlight,
-                                option->exposedRect);
+
+    if (selection.rectCount() < MASK_RECT_COUNT) {
+        renderer->drawTileSelection(painter, selection, highlight,
+                                    option->exposedRect);
+        return;
+    }
+
+    if (mMask.isNull())
+        updateMask(selection);
+    if (mMask.color(1) != highlight.rgba())
+        mMask.setColor(1, highlight.rgba());
+
+    renderer->drawTileMask(painter, mMask, mMaskPos, option->exposedRect);
 }
 
 void TileSelectionItem::selectionChanged(const QRegion &newSelection,
@@ -66,6 +81,7 @@ void TileSelectionItem::selectionChanged(const QRegion &newSelection,
 {
     prepareGeometryChange();
     updateBoundingRect();
+    mMask = QImage();
 
     // Make sure changes within the bounding rect are updated
     const QRect changedArea = newSelection.xored(oldSelection).boundingRect();
@@ -77,3 +93,26 @@ void TileSelectionItem::updateBoundingRect()
     const QRect b = mMapDocument->tileSelection().boundingRect();
     mBoundingRect = mMapDocument->renderer()->boundingRect(b);
 }
+
+void TileSelectionItem::updateMask(const QRegion &selection)
+{
+    const QRect bounds = selection.boundingRect();
+
+    // Color 0 is transparent, color 1 is set to the highlight color when
+    // painting
+    mMask = QImage(bounds.size(), QImage::Format_Mono);
+    mMask.setColorCount(2);
+    mMask.setColor(0, qRgba(0, 0, 0, 0));
+    mMask.setColor(1, qRgba(0, 0, 0, 0));
+    mMask.fill(0);
+    mMaskPos = bounds.topLeft();
+
+    foreach (const QRect &rect, selection.rects()) {
+        const QRect r = rect.translated(-mMaskPos);
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            uchar *line = mMask.scanLine(y);
+            for (int x = r.left(); x <= r.right(); ++x)
+                line[x >> 3] |= 0x80 >> (x & 7);
+        }
+    }
+}
@@ -22,7 +22,9 @@
 #define TILESELECTIONITEM_H
 
 #include <QObject>
+#include <QColor>
 #include <QGraphicsItem>
+#include <QImage>
 
 namespace Tiled {
 namespace Internal {
@@ -57,9 +59,18 @@ private slots:
 
 private:
     void updateBoundingRect();
+    void updateMask(const QRegion &selection);
 
     MapDocument *mMapDocument;
     QRectF mBoundingRect;
+
+    /**
+     * Fragmented selections are drawn from this image, in which each pixel
+     * covers a tile of the selection's bounding rect. It uses one bit per
+     * pixel, with the highlight color stored in its color table.
+     */
+    QImage mMask;
+    QPoint mMaskPos;
 };
 
 } // namespace Internal
@@ -21,6 +21,7 @@
 
 #include "tilesetmanager.h"
 
+#include "documentmanager.h"
 #include "filesystemwatcher.h"
 #include "tileset.h"
 
@@ -155,6 +156,9 @@ void TilesetManager::fileChanged(const QString &path)
 
 void TilesetManager::fileChangedTimeout()
 {
+    // Reloading replaces the tiles, which may be read by a background save
+    DocumentManager::instance()->waitForBackgroundSaves();
+
     foreach (Tileset *tileset, tilesets()) {
         QString fileName = tileset->imageSource();
         if (mChangedFiles.contains(fileName))
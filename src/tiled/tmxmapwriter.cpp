@@ -24,25 +24,86 @@
 #include "preferences.h"
 
 #include <QBuffer>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
 
 using namespace Tiled;
 using namespace Tiled::Internal;
 
 bool TmxMapWriter::write(const Map *map, const QString &fileName)
+{
+    readPreferences();
+    return writeMap(map, fileName);
+}
+
+void TmxMapWriter::readPreferences()
 {
     Preferences *prefs = Preferences::instance();
 
-    MapWriter writer;
-    writer.setLayerDataFormat(prefs->layerDataFormat());
-    writer.setDtdEnabled(prefs->dtdEnabled());
+    mMapWriter.setLayerDataFormat(prefs->layerDataFormat());
+    mMapWriter.setCompressionLevel(prefs->compressionLevel());
+    mMapWriter.setCompressionStrategy(prefs->compressionStrategy());
+    mMapWriter.setDtdEnabled(prefs->dtdEnabled());
+}
 
-    bool result = writer.writeMap(map, fileName);
-    if (!result)
-        mError = writer.errorString();
-    else
-        mError.clear();
+/**
+ * Replaces the file at \a to with the file at \a from, in a single step
+ * where the platform supports it.
+ */
+static bool replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t*>(from.utf16()),
+                       reinterpret_cast<const wchar_t*>(to.utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    return ::rename(QFile::encodeName(from).constData(),
+                    QFile::encodeName(to).constData()) == 0;
+#endif
+}
 
-    return result;
+bool TmxMapWriter::writeMap(const Map *map, const QString &fileName)
+{
+    QTemporaryFile file(fileName + QLatin1String(".XXXXXX"));
+    if (!file.open()) {
+        mError = tr("Could not open file for writing.");
+        return false;
+    }
+
+    mMapWriter.writeMap(map, &file, QFileInfo(fileName).absolutePath());
+    file.close();
+
+    if (!mMapWriter.errorString().isEmpty()) {
+        mError = mMapWriter.errorString();
+        return false;
+    }
+
+    if (file.error() != QFile::NoError) {
+        mError = file.errorString();
+        return false;
+    }
+
+    // Temporary files are only accessible by the owner
+    const QFile::Permissions permissions = QFile::exists(fileName)
+            ? QFile::permissions(fileName)
+            : QFile::ReadOwner | QFile::WriteOwner | QFile::ReadUser |
+              QFile::WriteUser | QFile::ReadGroup | QFile::ReadOther;
+    file.setPermissions(permissions);
+
+    if (!replaceFile(file.fileName(), fileName)) {
+        mError = tr("Could not replace %1.").arg(fileName);
+        return false;
+    }
+
+    file.setAutoRemove(false);
+    mError.clear();
+    return true;
 }
 
 bool TmxMapWriter::writeTileset(const Tileset *tileset,
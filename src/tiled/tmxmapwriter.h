@@ -21,6 +21,7 @@
 #ifndef TMXMAPWRITER_H
 #define TMXMAPWRITER_H
 
+#include "mapwriter.h"
 #include "mapwriterinterface.h"
 
 #include <QCoreApplication>
@@ -40,8 +41,30 @@ class TmxMapWriter : public MapWriterInterface
     Q_DECLARE_TR_FUNCTIONS(TmxMapReader)
 
 public:
+    /**
+     * Writes the map using the storage preferences. Writing the same map
+     * again with the same writer reuses the encoded data of the tile layers
+     * that did not change.
+     */
     bool write(const Map *map, const QString &fileName);
 
+    /**
+     * Applies the storage preferences to this writer. Like all access to the
+     * preferences, this needs to happen on the GUI thread.
+     */
+    void readPreferences();
+
+    /**
+     * Writes the map using the storage preferences as read by the last call
+     * to readPreferences(). Does not access the preferences, so it can be
+     * called from a worker thread.
+     *
+     * The map is written to a temporary file first, which then replaces the
+     * file at \a fileName. This way an existing map is never left behind
+     * partially written.
+     */
+    bool writeMap(const Map *map, const QString &fileName);
+
     bool writeTileset(const Tileset *tileset, const QString &fileName);
 
     /**
@@ -57,7 +80,14 @@ public:
 
     QString errorString() const { return mError; }
 
+    /**
+     * Returns the statistics about the layer data of the map written last.
+     */
+    QList<MapWriter::LayerDataStatistics> layerDataStatistics() const
+    { return mMapWriter.layerDataStatistics(); }
+
 private:
+    MapWriter mMapWriter;
     QString mError;
 };
 
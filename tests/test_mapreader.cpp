@@ -1,19 +1,83 @@
+#include "binarymap.h"
 #include "map.h"
 #include "mapobject.h"
 #include "objectgroup.h"
+#include "solidrectangles.h"
 #include "tilelayer.h"
 #include "mapreader.h"
+#include "mapwriter.h"
+#include "tile.h"
+#include "tileset.h"
 
+#include <QBuffer>
+#include <QDir>
+#include <QTemporaryFile>
 #include <QtTest/QtTest>
 
 using namespace Tiled;
 
+namespace {
+
+/**
+ * A map reader that generates tileset images instead of loading them, so
+ * that tests can write and read back maps with tiles.
+ */
+class GeneratedImageMapReader : public MapReader
+{
+protected:
+    QImage readExternalImage(const QString &)
+    {
+        QImage image(128, 128, QImage::Format_ARGB32);
+        image.fill(0xff808080);
+        return image;
+    }
+};
+
+/**
+ * Returns whether the \a rectangles lie within the \a tileLayer, don't
+ * overlap and cover exactly its non-empty cells.
+ */
+bool coversSolidCells(const TileLayer *tileLayer,
+                      const QVector<QRect> &rectangles)
+{
+    const QRect bounds(0, 0, tileLayer->width(), tileLayer->height());
+    QVector<int> coverCount(bounds.width() * bounds.height(), 0);
+
+    foreach (const QRect &rect, rectangles) {
+        if (rect.isEmpty() || !bounds.contains(rect))
+            return false;
+
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            for (int x = rect.left(); x <= rect.right(); ++x)
+                ++coverCount[x + y * bounds.width()];
+    }
+
+    for (int y = 0; y < bounds.height(); ++y) {
+        for (int x = 0; x < bounds.width(); ++x) {
+            const int expected = tileLayer->cellAt(x, y).isEmpty() ? 0 : 1;
+            if (coverCount.at(x + y * bounds.width()) != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // anonymous namespace
+
 class test_MapReader : public QObject
 {
     Q_OBJECT
 
 private slots:
     void loadMap();
+    void loadMapDeferred();
+    void loadMapDeferredCorrupt();
+    void loadFilteredLayerData();
+    void loadChunkedLayerData();
+    void binaryMapRoundTrip();
+    void binaryMapCorrupt();
+    void mergeSolidRectangles();
 };
 
 void test_MapReader::loadMap()
@@ -53,5 +117,522 @@ void test_MapReader::loadMap()
     QCOMPARE(mapObject->height(), qreal(64) / qreal(map->tileHeight()));
 }
 
+void test_MapReader::loadMapDeferred()
+{
+    MapReader reader;
+    reader.setLayerDecodingDeferred(true);
+    Map *map = reader.readMap("data/mapobject.tmx");
+
+    QVERIFY(map);
+
+    TileLayer *tileLayer = dynamic_cast<TileLayer*>(map->layerAt(0));
+
+    QVERIFY(tileLayer);
+    QVERIFY(tileLayer->isDecodingDeferred());
+    QVERIFY(tileLayer->cellAt(0, 0).isEmpty());
+    QVERIFY(!tileLayer->isDecodingDeferred());
+    QVERIFY(tileLayer->isEmpty());
+}
+
+void test_MapReader::loadMapDeferredCorrupt()
+{
+    QByteArray bytes(
+            "<map version=\"1.0\" orientation=\"orthogonal\""
+            " width=\"2\" height=\"2\" tilewidth=\"32\" tileheight=\"32\">"
+            " <layer name=\"Broken\" width=\"2\" height=\"2\">"
+            "  <data encoding=\"base64\" compression=\"zlib\">AAAA</data>"
+            " </layer>"
+            "</map>");
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::ReadOnly);
+
+    MapReader reader;
+    reader.setLayerDecodingDeferred(true);
+    Map *map = reader.readMap(&buffer);
+
+    QVERIFY(map);
+
+    TileLayer *tileLayer = dynamic_cast<TileLayer*>(map->layerAt(0));
+
+    QVERIFY(tileLayer);
+    QVERIFY(!tileLayer->decodingError().isEmpty());
+
+    // Saving the map would lose the layer data
+    QByteArray written;
+    QBuffer output(&written);
+    output.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.writeMap(map, &output);
+
+    QVERIFY(!writer.errorString().isEmpty());
+    QVERIFY(written.isEmpty());
+
+    // A refused save must leave an existing file untouched
+    QTemporaryFile existing;
+    QVERIFY(existing.open());
+    existing.write("original");
+    existing.close();
+
+    QVERIFY(!writer.writeMap(map, existing.fileName()));
+    QVERIFY(!writer.errorString().isEmpty());
+
+    QVERIFY(existing.open());
+    QCOMPARE(existing.readAll(), QByteArray("original"));
+
+    delete map;
+}
+
+void test_MapReader::loadFilteredLayerData()
+{
+    QImage image(128, 128, QImage::Format_ARGB32);
+    image.fill(0xff808080);
+
+    Tileset *tileset = new Tileset(QLatin1String("Tiles"), 32, 32);
+    QVERIFY(tileset->loadFromImage(image, QLatin1String("tiles.png")));
+    QCOMPARE(tileset->tileCount(), 16);
+
+    Map *map = new Map(Map::Orthogonal, 40, 30, 32, 32);
+    map->addTileset(tileset);
+
+    // Runs of equal cells, separated by empty and flipped or rotated cells
+    TileLayer *tileLayer = new TileLayer(QLatin1String("Tiles"), 0, 0,
+                                         40, 30);
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            if ((x + y) % 11 == 0)
+                continue;
+
+            Cell cell(tileset->tileAt((x / 4 + y * 3) % 16));
+            cell.flippedHorizontally = (y % 3 == 1);
+            cell.flippedVertically = (x % 7 == 0);
+            cell.setRotation(x % 9 == 0 ? y : 0);
+            tileLayer->setCell(x, y, cell);
+        }
+    }
+    map->addLayer(tileLayer);
+
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.setLayerDataFormat(MapWriter::Base64Zlib);
+    writer.setLayerDataFilters(QList<FilterMethod>()
+                               << RowDelta << RunLength << ByteShuffle);
+    writer.writeMap(map, &buffer);
+    buffer.close();
+
+    QVERIFY(bytes.contains("compression=\"delta+rle+shuffle+zlib\""));
+
+    buffer.open(QIODevice::ReadOnly);
+    GeneratedImageMapReader reader;
+    Map *filteredMap = reader.readMap(&buffer);
+
+    QVERIFY(filteredMap);
+    QCOMPARE(filteredMap->layerCount(), 1);
+    QCOMPARE(filteredMap->tilesets().size(), 1);
+
+    TileLayer *filteredLayer =
+            dynamic_cast<TileLayer*>(filteredMap->layerAt(0));
+
+    QVERIFY(filteredLayer);
+    QCOMPARE(filteredLayer->width(), 40);
+    QCOMPARE(filteredLayer->height(), 30);
+
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            const Cell &cell = tileLayer->cellAt(x, y);
+            const Cell &filteredCell = filteredLayer->cellAt(x, y);
+
+            QCOMPARE(filteredCell.isEmpty(), cell.isEmpty());
+            if (cell.isEmpty())
+                continue;
+
+            QCOMPARE(filteredCell.tile->id(), cell.tile->id());
+            QCOMPARE(filteredCell.flippedHorizontally,
+                     cell.flippedHorizontally);
+            QCOMPARE(filteredCell.flippedVertically, cell.flippedVertically);
+            QCOMPARE(filteredCell.ang, cell.ang);
+        }
+    }
+
+    qDeleteAll(filteredMap->tilesets());
+    delete filteredMap;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapReader::loadChunkedLayerData()
+{
+    QImage image(128, 128, QImage::Format_ARGB32);
+    image.fill(0xff808080);
+
+    Tileset *tileset = new Tileset(QLatin1String("Tiles"), 32, 32);
+    QVERIFY(tileset->loadFromImage(image, QLatin1String("tiles.png")));
+
+    Map *map = new Map(Map::Orthogonal, 40, 30, 32, 32);
+    map->addTileset(tileset);
+
+    // The bottom right corner is left empty, so its chunk is left out
+    TileLayer *tileLayer = new TileLayer(QLatin1String("Tiles"), 0, 0,
+                                         40, 30);
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            if ((x >= 32 && y >= 16) || (x + y) % 7 == 0)
+                continue;
+
+            Cell cell(tileset->tileAt((x + y * 5) % 16));
+            cell.flippedHorizontally = (x % 3 == 0);
+            cell.flippedVertically = (y % 2 == 0);
+            tileLayer->setCell(x, y, cell);
+        }
+    }
+    map->addLayer(tileLayer);
+
+    QTemporaryFile tmxFile(QDir::tempPath() +
+                           QLatin1String("/test_mapreader_XXXXXX"));
+    QVERIFY(tmxFile.open());
+    tmxFile.close();
+
+    const QSize chunkSize(16, 16);
+
+    MapWriter writer;
+    writer.setLayerDataFormat(MapWriter::Base64Zlib);
+    writer.setChunkSize(chunkSize);
+    QVERIFY(writer.writeMap(map, tmxFile.fileName()));
+
+    QVERIFY(tmxFile.open());
+    const QByteArray bytes = tmxFile.readAll();
+    tmxFile.close();
+
+    QCOMPARE(bytes.count("<chunk"), 5);
+
+    // Read the whole map
+    GeneratedImageMapReader reader;
+    Map *fullMap = reader.readMap(tmxFile.fileName());
+
+    QVERIFY2(fullMap, qPrintable(reader.errorString()));
+    QCOMPARE(fullMap->layerCount(), 1);
+
+    TileLayer *fullLayer = dynamic_cast<TileLayer*>(fullMap->layerAt(0));
+
+    QVERIFY(fullLayer);
+    QCOMPARE(fullLayer->width(), 40);
+    QCOMPARE(fullLayer->height(), 30);
+
+    // Read a region, which only needs the chunk at (16, 0)
+    const QRect region(20, 4, 8, 8);
+    Map *regionMap = reader.readMapRegion(tmxFile.fileName(), region);
+
+    QVERIFY2(regionMap, qPrintable(reader.errorString()));
+    QCOMPARE(regionMap->layerCount(), 1);
+
+    TileLayer *regionLayer = dynamic_cast<TileLayer*>(regionMap->layerAt(0));
+
+    QVERIFY(regionLayer);
+    QCOMPARE(regionLayer->width(), 40);
+    QCOMPARE(regionLayer->height(), 30);
+
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            const Cell &cell = tileLayer->cellAt(x, y);
+            const Cell &fullCell = fullLayer->cellAt(x, y);
+
+            QCOMPARE(fullCell.isEmpty(), cell.isEmpty());
+            if (!cell.isEmpty()) {
+                QCOMPARE(fullCell.tile->id(), cell.tile->id());
+                QCOMPARE(fullCell.flippedHorizontally,
+                         cell.flippedHorizontally);
+                QCOMPARE(fullCell.flippedVertically,
+                         cell.flippedVertically);
+            }
+
+            // Cells outside of the chunks touching the region stay empty
+            const QRect chunk(x / 16 * 16, y / 16 * 16, 16, 16);
+            const Cell &regionCell = regionLayer->cellAt(x, y);
+
+            if (!chunk.intersects(region)) {
+                QVERIFY(regionCell.isEmpty());
+                continue;
+            }
+
+            QCOMPARE(regionCell.isEmpty(), cell.isEmpty());
+            if (!cell.isEmpty()) {
+                QCOMPARE(regionCell.tile->id(), cell.tile->id());
+                QCOMPARE(regionCell.flippedHorizontally,
+                         cell.flippedHorizontally);
+                QCOMPARE(regionCell.flippedVertically,
+                         cell.flippedVertically);
+            }
+        }
+    }
+
+    qDeleteAll(regionMap->tilesets());
+    delete regionMap;
+    qDeleteAll(fullMap->tilesets());
+    delete fullMap;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapReader::binaryMapRoundTrip()
+{
+    const QString tempTemplate =
+            QDir::tempPath() + QLatin1String("/test_mapreader_XXXXXX");
+
+    // The binary map reader loads the tileset image from disk
+    QImage image(128, 128, QImage::Format_ARGB32);
+    image.fill(0xff808080);
+
+    QTemporaryFile imageFile(tempTemplate);
+    QVERIFY(imageFile.open());
+    QVERIFY(image.save(&imageFile, "PNG"));
+    imageFile.close();
+
+    Tileset *tileset = new Tileset(QLatin1String("Tiles"), 32, 32);
+    QVERIFY(tileset->loadFromImage(image, imageFile.fileName()));
+    tileset->tileAt(3)->setProperty(QLatin1String("solid"),
+                                    QLatin1String("true"));
+
+    Map *map = new Map(Map::Orthogonal, 12, 10, 32, 32);
+    map->setProperty(QLatin1String("author"), QLatin1String("Tiled"));
+    map->addTileset(tileset);
+
+    TileLayer *tileLayer = new TileLayer(QLatin1String("Ground"), 0, 0,
+                                         12, 10);
+    tileLayer->setProperty(QLatin1String("depth"), QLatin1String("2"));
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            if ((x * y) % 5 == 1)
+                continue;
+
+            Cell cell(tileset->tileAt((x + y * 12) % 16));
+            cell.flippedHorizontally = (x % 2 == 1);
+            cell.flippedVertically = (y % 3 == 0);
+            cell.setRotation(x % 4 == 0 ? y : 0);
+            tileLayer->setCell(x, y, cell);
+        }
+    }
+    map->addLayer(tileLayer);
+
+    ObjectGroup *objectGroup = new ObjectGroup(QLatin1String("Objects"),
+                                               0, 0, 12, 10);
+    MapObject *tileObject = new MapObject(QLatin1String("Chest"),
+                                          QLatin1String("ITEM"),
+                                          QPointF(2, 3), QSizeF(1, 1));
+    tileObject->setTile(tileset->tileAt(5));
+    tileObject->setFlipHorizontally(true);
+    tileObject->setRotation(1);
+    tileObject->setProperty(QLatin1String("gold"), QLatin1String("100"));
+    objectGroup->addObject(tileObject);
+
+    MapObject *polygonObject = new MapObject(QLatin1String("Area"),
+                                             QString(), QPointF(4, 4),
+                                             QSizeF());
+    polygonObject->setShape(MapObject::Polygon);
+    polygonObject->setPolygon(QPolygonF() << QPointF(0, 0) << QPointF(2, 0)
+                                          << QPointF(1, 2));
+    objectGroup->addObject(polygonObject);
+    map->addLayer(objectGroup);
+
+    // Save as TMX, read it back and convert it to the binary format
+    QTemporaryFile tmxFile(tempTemplate);
+    QVERIFY(tmxFile.open());
+    tmxFile.close();
+
+    MapWriter writer;
+    QVERIFY(writer.writeMap(map, tmxFile.fileName()));
+
+    MapReader reader;
+    Map *tmxMap = reader.readMap(tmxFile.fileName());
+    QVERIFY2(tmxMap, qPrintable(reader.errorString()));
+
+    QTemporaryFile tmbFile(tempTemplate);
+    QVERIFY(tmbFile.open());
+    tmbFile.close();
+
+    BinaryMapWriter binaryWriter;
+    QVERIFY2(binaryWriter.writeMap(tmxMap, tmbFile.fileName()),
+             qPrintable(binaryWriter.errorString()));
+    QVERIFY(BinaryMapReader::isBinaryMap(tmbFile.fileName()));
+
+    BinaryMapReader binaryReader;
+    Map *binaryMap = binaryReader.readMap(tmbFile.fileName());
+    QVERIFY2(binaryMap, qPrintable(binaryReader.errorString()));
+
+    QCOMPARE(binaryMap->properties(), map->properties());
+    QCOMPARE(binaryMap->tilesets().size(), 1);
+    QCOMPARE(binaryMap->tilesets().first()->tileCount(), 16);
+    QCOMPARE(binaryMap->tilesets().first()->tileAt(3)->properties(),
+             tileset->tileAt(3)->properties());
+    QCOMPARE(binaryMap->layerCount(), 2);
+
+    TileLayer *binaryLayer = dynamic_cast<TileLayer*>(binaryMap->layerAt(0));
+
+    QVERIFY(binaryLayer);
+    QCOMPARE(binaryLayer->name(), tileLayer->name());
+    QCOMPARE(binaryLayer->width(), tileLayer->width());
+    QCOMPARE(binaryLayer->height(), tileLayer->height());
+    QCOMPARE(binaryLayer->properties(), tileLayer->properties());
+
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            const Cell &cell = tileLayer->cellAt(x, y);
+            const Cell &binaryCell = binaryLayer->cellAt(x, y);
+
+            QCOMPARE(binaryCell.isEmpty(), cell.isEmpty());
+            if (cell.isEmpty())
+                continue;
+
+            QCOMPARE(binaryCell.tile->id(), cell.tile->id());
+            QCOMPARE(binaryCell.flippedHorizontally,
+                     cell.flippedHorizontally);
+            QCOMPARE(binaryCell.flippedVertically, cell.flippedVertically);
+            QCOMPARE(binaryCell.ang, cell.ang);
+        }
+    }
+
+    ObjectGroup *binaryGroup =
+            dynamic_cast<ObjectGroup*>(binaryMap->layerAt(1));
+
+    QVERIFY(binaryGroup);
+    QCOMPARE(binaryGroup->objectCount(), 2);
+
+    for (int i = 0; i < 2; ++i) {
+        const MapObject *object = objectGroup->objects().at(i);
+        const MapObject *binaryObject = binaryGroup->objects().at(i);
+
+        QCOMPARE(binaryObject->name(), object->name());
+        QCOMPARE(binaryObject->type(), object->type());
+        QCOMPARE(binaryObject->position(), object->position());
+        QCOMPARE(binaryObject->size(), object->size());
+        QCOMPARE(binaryObject->shape(), object->shape());
+        QCOMPARE(binaryObject->polygon(), object->polygon());
+        QCOMPARE(binaryObject->properties(), object->properties());
+
+        const Cell cell = object->getCell();
+        const Cell binaryCell = binaryObject->getCell();
+
+        QCOMPARE(binaryCell.isEmpty(), cell.isEmpty());
+        if (cell.isEmpty())
+            continue;
+
+        QCOMPARE(binaryCell.tile->id(), cell.tile->id());
+        QCOMPARE(binaryCell.flippedHorizontally, cell.flippedHorizontally);
+        QCOMPARE(binaryCell.flippedVertically, cell.flippedVertically);
+        QCOMPARE(binaryCell.ang, cell.ang);
+    }
+
+    qDeleteAll(binaryMap->tilesets());
+    delete binaryMap;
+    qDeleteAll(tmxMap->tilesets());
+    delete tmxMap;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapReader::binaryMapCorrupt()
+{
+    const QString tempTemplate =
+            QDir::tempPath() + QLatin1String("/test_mapreader_XXXXXX");
+
+    Map *map = new Map(Map::Orthogonal, 8, 8, 32, 32);
+    map->addLayer(new TileLayer(QLatin1String("Empty"), 0, 0, 8, 8));
+
+    QTemporaryFile tmbFile(tempTemplate);
+    QVERIFY(tmbFile.open());
+    tmbFile.close();
+
+    BinaryMapWriter writer;
+    QVERIFY2(writer.writeMap(map, tmbFile.fileName()),
+             qPrintable(writer.errorString()));
+    delete map;
+
+    QVERIFY(tmbFile.open());
+    const QByteArray contents = tmbFile.readAll();
+    tmbFile.close();
+
+    // Cut off halfway through the tile data
+    QTemporaryFile truncatedFile(tempTemplate);
+    QVERIFY(truncatedFile.open());
+    truncatedFile.write(contents.left(contents.size() / 2));
+    truncatedFile.close();
+
+    BinaryMapReader reader;
+    QVERIFY(!reader.readMap(truncatedFile.fileName()));
+    QVERIFY(!reader.errorString().isEmpty());
+
+    // A tile data size in the layer directory that doesn't match the layer
+    QByteArray corrupt = contents;
+    corrupt[32] = char(0xff);
+
+    QTemporaryFile corruptFile(tempTemplate);
+    QVERIFY(corruptFile.open());
+    corruptFile.write(corrupt);
+    corruptFile.close();
+
+    QVERIFY(!reader.readMap(corruptFile.fileName()));
+    QVERIFY(!reader.errorString().isEmpty());
+}
+
+void test_MapReader::mergeSolidRectangles()
+{
+    QImage image(32, 32, QImage::Format_ARGB32);
+    image.fill(0xff808080);
+
+    Tileset *tileset = new Tileset(QLatin1String("Tiles"), 32, 32);
+    QVERIFY(tileset->loadFromImage(image, QLatin1String("tiles.png")));
+    const Cell solid(tileset->tileAt(0));
+
+    // A checkerboard can't be merged at all
+    TileLayer checkerboard(QLatin1String("Checkerboard"), 0, 0, 6, 6);
+    for (int y = 0; y < 6; ++y)
+        for (int x = 0; x < 6; ++x)
+            if ((x + y) % 2 == 0)
+                checkerboard.setCell(x, y, solid);
+
+    QVector<QRect> rectangles = Tiled::solidRectangles(&checkerboard);
+    QCOMPARE(rectangles.size(), 18);
+    QVERIFY(coversSolidCells(&checkerboard, rectangles));
+
+    // An L-shape consists of a vertical and a horizontal bar
+    TileLayer lShape(QLatin1String("L-shape"), 0, 0, 6, 6);
+    for (int y = 0; y < 6; ++y)
+        for (int x = 0; x < 6; ++x)
+            if (x < 2 || y >= 4)
+                lShape.setCell(x, y, solid);
+
+    rectangles = Tiled::solidRectangles(&lShape);
+    QCOMPARE(rectangles.size(), 2);
+    QVERIFY(coversSolidCells(&lShape, rectangles));
+
+    // The rectangles are in local coordinates, the objects are not
+    TileLayer offsetLayer(QLatin1String("Offset"), 3, 2, 4, 3);
+    for (int y = 0; y < 3; ++y)
+        for (int x = 0; x < 4; ++x)
+            if (x != 3 || y != 2)
+                offsetLayer.setCell(x, y, solid);
+
+    rectangles = Tiled::solidRectangles(&offsetLayer);
+    QCOMPARE(rectangles.size(), 2);
+    QVERIFY(coversSolidCells(&offsetLayer, rectangles));
+
+    ObjectGroup *objectGroup = solidRectanglesObjectGroup(&offsetLayer);
+    QCOMPARE(objectGroup->objectCount(), rectangles.size());
+
+    for (int i = 0; i < rectangles.size(); ++i) {
+        const MapObject *object = objectGroup->objects().at(i);
+        const QRect &rect = rectangles.at(i);
+
+        QCOMPARE(object->type(), QLatin1String("collision"));
+        QCOMPARE(object->position(), QPointF(rect.topLeft() + QPoint(3, 2)));
+        QCOMPARE(object->size(), QSizeF(rect.size()));
+    }
+
+    delete objectGroup;
+    delete tileset;
+}
+
 QTEST_MAIN(test_MapReader)
 #include "test_mapreader.moc"